@@ -0,0 +1,367 @@
+// st40_top with the clocks, the timestamp counter and the AFE samples generated in the HDL
+// while dpi_mode is high. The C++ side (daphne_st_dpi_bridge) hands over blocks of samples
+// through DPI-C and calls run() once per block instead of driving every clock edge. Only the
+// dout/kout words that are not idles come back, tagged with their fclk cycle, so idle cycles
+// cost nothing on the C++ side. With dpi_mode low this is st40_top_wrapper: reset and configuration
+// go through the ports as before.
+module st40_top_dpi_wrapper(
+    input wire dpi_mode,
+    input wire reset_aclk,
+    input wire reset_fclk,
+    input wire [7:0] adhoc,
+    input wire [13:0] st_config,
+    input wire [4:0] signal_delay,
+    input wire [41:0] threshold_xc,
+    input wire [7:0] ti_trigger,
+    input wire ti_trigger_stbr,
+    input wire reset_st_counters,
+    input wire [3:0] slot_id,
+    input wire [9:0] crate_id,
+    input wire [5:0] detector_id,
+    input wire [5:0] version_id,
+    input wire [39:0] enable,
+    input wire [39:0] afe_comp_enable,
+    input wire [39:0] invert_enable,
+    input wire [5:0] st_40_signals_enable_reg,
+    output wire st_40_selftrigger_4_spybuffer,
+    input wire [1:0] filter_output_selector,
+    input wire aclk,
+    input wire [63:0] timestamp,
+    input wire [13:0] afe_dat_0_0,
+    input wire [13:0] afe_dat_0_1,
+    input wire [13:0] afe_dat_0_2,
+    input wire [13:0] afe_dat_0_3,
+    input wire [13:0] afe_dat_0_4,
+    input wire [13:0] afe_dat_0_5,
+    input wire [13:0] afe_dat_0_6,
+    input wire [13:0] afe_dat_0_7,
+    input wire [13:0] afe_dat_0_8,
+    input wire [13:0] afe_dat_1_0,
+    input wire [13:0] afe_dat_1_1,
+    input wire [13:0] afe_dat_1_2,
+    input wire [13:0] afe_dat_1_3,
+    input wire [13:0] afe_dat_1_4,
+    input wire [13:0] afe_dat_1_5,
+    input wire [13:0] afe_dat_1_6,
+    input wire [13:0] afe_dat_1_7,
+    input wire [13:0] afe_dat_1_8,
+    input wire [13:0] afe_dat_2_0,
+    input wire [13:0] afe_dat_2_1,
+    input wire [13:0] afe_dat_2_2,
+    input wire [13:0] afe_dat_2_3,
+    input wire [13:0] afe_dat_2_4,
+    input wire [13:0] afe_dat_2_5,
+    input wire [13:0] afe_dat_2_6,
+    input wire [13:0] afe_dat_2_7,
+    input wire [13:0] afe_dat_2_8,
+    input wire [13:0] afe_dat_3_0,
+    input wire [13:0] afe_dat_3_1,
+    input wire [13:0] afe_dat_3_2,
+    input wire [13:0] afe_dat_3_3,
+    input wire [13:0] afe_dat_3_4,
+    input wire [13:0] afe_dat_3_5,
+    input wire [13:0] afe_dat_3_6,
+    input wire [13:0] afe_dat_3_7,
+    input wire [13:0] afe_dat_3_8,
+    input wire [13:0] afe_dat_4_0,
+    input wire [13:0] afe_dat_4_1,
+    input wire [13:0] afe_dat_4_2,
+    input wire [13:0] afe_dat_4_3,
+    input wire [13:0] afe_dat_4_4,
+    input wire [13:0] afe_dat_4_5,
+    input wire [13:0] afe_dat_4_6,
+    input wire [13:0] afe_dat_4_7,
+    input wire [13:0] afe_dat_4_8,
+    output wire [13:0] afe_dat_0_0_filtered,
+    output wire [13:0] afe_dat_0_1_filtered,
+    output wire [13:0] afe_dat_0_2_filtered,
+    output wire [13:0] afe_dat_0_3_filtered,
+    output wire [13:0] afe_dat_0_4_filtered,
+    output wire [13:0] afe_dat_0_5_filtered,
+    output wire [13:0] afe_dat_0_6_filtered,
+    output wire [13:0] afe_dat_0_7_filtered,
+    output wire [13:0] afe_dat_0_8_filtered,
+    output wire [13:0] afe_dat_1_0_filtered,
+    output wire [13:0] afe_dat_1_1_filtered,
+    output wire [13:0] afe_dat_1_2_filtered,
+    output wire [13:0] afe_dat_1_3_filtered,
+    output wire [13:0] afe_dat_1_4_filtered,
+    output wire [13:0] afe_dat_1_5_filtered,
+    output wire [13:0] afe_dat_1_6_filtered,
+    output wire [13:0] afe_dat_1_7_filtered,
+    output wire [13:0] afe_dat_1_8_filtered,
+    output wire [13:0] afe_dat_2_0_filtered,
+    output wire [13:0] afe_dat_2_1_filtered,
+    output wire [13:0] afe_dat_2_2_filtered,
+    output wire [13:0] afe_dat_2_3_filtered,
+    output wire [13:0] afe_dat_2_4_filtered,
+    output wire [13:0] afe_dat_2_5_filtered,
+    output wire [13:0] afe_dat_2_6_filtered,
+    output wire [13:0] afe_dat_2_7_filtered,
+    output wire [13:0] afe_dat_2_8_filtered,
+    output wire [13:0] afe_dat_3_0_filtered,
+    output wire [13:0] afe_dat_3_1_filtered,
+    output wire [13:0] afe_dat_3_2_filtered,
+    output wire [13:0] afe_dat_3_3_filtered,
+    output wire [13:0] afe_dat_3_4_filtered,
+    output wire [13:0] afe_dat_3_5_filtered,
+    output wire [13:0] afe_dat_3_6_filtered,
+    output wire [13:0] afe_dat_3_7_filtered,
+    output wire [13:0] afe_dat_3_8_filtered,
+    output wire [13:0] afe_dat_4_0_filtered,
+    output wire [13:0] afe_dat_4_1_filtered,
+    output wire [13:0] afe_dat_4_2_filtered,
+    output wire [13:0] afe_dat_4_3_filtered,
+    output wire [13:0] afe_dat_4_4_filtered,
+    output wire [13:0] afe_dat_4_5_filtered,
+    output wire [13:0] afe_dat_4_6_filtered,
+    output wire [13:0] afe_dat_4_7_filtered,
+    output wire [13:0] afe_dat_4_8_filtered,
+    input wire oeiclk,
+    input wire fclk,
+    output wire [31:0] dout,
+    output wire [3:0] kout,
+    input wire [31:0] Rcount_addr,
+    output wire [63:0] Rcount
+);
+
+    localparam integer DPI_BLOCK_SAMPLES = 1024;
+
+    // Returns the number of 40-input samples written to block (sample-major, input 8*afe + channel), 0 once the input is over.
+    import "DPI-C" function int daphne_st_dpi_fetch_block(output shortint block[0:40*DPI_BLOCK_SAMPLES-1], input int max_samples);
+    import "DPI-C" function void daphne_st_dpi_push_word(input longint unsigned cycle, input int unsigned word, input int unsigned k);
+
+    reg aclk_gen = 1'b0;
+    reg fclk_gen = 1'b0;
+    reg [63:0] timestamp_gen = 64'd0;
+    reg [63:0] fclk_cycle = 64'd0;
+    reg [13:0] afe_dpi [0:39];
+    shortint block [0:40*DPI_BLOCK_SAMPLES-1];
+    integer block_samples = 0;
+    integer block_index = 0;
+    integer i;
+
+    initial begin
+        for(i = 0; i < 40; i = i + 1) afe_dpi[i] = 14'd0;
+    end
+
+    // 125 MHz fclk/oeiclk and 62.5 MHz aclk, aclk changing with the fclk falling edge as in cycle_f_clock()
+    always begin
+        if(dpi_mode === 1'b1) begin
+            #4 fclk_gen = 1'b1;
+            #4 fclk_gen = 1'b0;
+               aclk_gen = ~aclk_gen;
+        end else begin
+            fclk_gen = 1'b0;
+            aclk_gen = 1'b0;
+            @(posedge dpi_mode);
+        end
+    end
+
+    // the next sample goes on the inputs while aclk is low, as set_input_signal_ports() does
+    task next_sample;
+        begin
+            if(block_index == block_samples) begin
+                block_samples = daphne_st_dpi_fetch_block(block, DPI_BLOCK_SAMPLES);
+                block_index = 0;
+            end
+            // past the end of the input the last sample is held
+            if(block_index < block_samples) begin
+                for(i = 0; i < 40; i = i + 1) afe_dpi[i] <= block[40*block_index + i][13:0];
+                block_index = block_index + 1;
+            end
+        end
+    endtask
+
+    always @(posedge dpi_mode) begin
+        block_samples = 0;
+        block_index = 0;
+        timestamp_gen = timestamp;
+        fclk_cycle = 64'd0;
+        next_sample();
+    end
+
+    always @(negedge aclk_gen) begin
+        if(dpi_mode === 1'b1) next_sample();
+    end
+
+    // the value the first aclk edge sees is the one on the timestamp port when dpi_mode rose
+    always @(posedge aclk_gen) begin
+        if(dpi_mode === 1'b1) timestamp_gen <= timestamp_gen + 64'd1;
+    end
+
+    // dout is registered on fclk, read it half a period later like cycle_and_capture_output();
+    // idles (0x000000BC with kout 0001) stay here, the cycle number lets C++ put them back
+    always @(negedge fclk_gen) begin
+        if(dpi_mode === 1'b1) begin
+            if(!(kout == 4'b0001 && dout == 32'h000000BC)) daphne_st_dpi_push_word(fclk_cycle, dout, kout);
+            fclk_cycle <= fclk_cycle + 64'd1;
+        end
+    end
+
+    wire aclk_i = dpi_mode ? aclk_gen : aclk;
+    wire fclk_i = dpi_mode ? fclk_gen : fclk;
+    wire oeiclk_i = dpi_mode ? fclk_gen : oeiclk;
+    wire [63:0] timestamp_i = dpi_mode ? timestamp_gen : timestamp;
+    wire [13:0] afe_dat_0_0_i = dpi_mode ? afe_dpi[0] : afe_dat_0_0;
+    wire [13:0] afe_dat_0_1_i = dpi_mode ? afe_dpi[1] : afe_dat_0_1;
+    wire [13:0] afe_dat_0_2_i = dpi_mode ? afe_dpi[2] : afe_dat_0_2;
+    wire [13:0] afe_dat_0_3_i = dpi_mode ? afe_dpi[3] : afe_dat_0_3;
+    wire [13:0] afe_dat_0_4_i = dpi_mode ? afe_dpi[4] : afe_dat_0_4;
+    wire [13:0] afe_dat_0_5_i = dpi_mode ? afe_dpi[5] : afe_dat_0_5;
+    wire [13:0] afe_dat_0_6_i = dpi_mode ? afe_dpi[6] : afe_dat_0_6;
+    wire [13:0] afe_dat_0_7_i = dpi_mode ? afe_dpi[7] : afe_dat_0_7;
+    wire [13:0] afe_dat_1_0_i = dpi_mode ? afe_dpi[8] : afe_dat_1_0;
+    wire [13:0] afe_dat_1_1_i = dpi_mode ? afe_dpi[9] : afe_dat_1_1;
+    wire [13:0] afe_dat_1_2_i = dpi_mode ? afe_dpi[10] : afe_dat_1_2;
+    wire [13:0] afe_dat_1_3_i = dpi_mode ? afe_dpi[11] : afe_dat_1_3;
+    wire [13:0] afe_dat_1_4_i = dpi_mode ? afe_dpi[12] : afe_dat_1_4;
+    wire [13:0] afe_dat_1_5_i = dpi_mode ? afe_dpi[13] : afe_dat_1_5;
+    wire [13:0] afe_dat_1_6_i = dpi_mode ? afe_dpi[14] : afe_dat_1_6;
+    wire [13:0] afe_dat_1_7_i = dpi_mode ? afe_dpi[15] : afe_dat_1_7;
+    wire [13:0] afe_dat_2_0_i = dpi_mode ? afe_dpi[16] : afe_dat_2_0;
+    wire [13:0] afe_dat_2_1_i = dpi_mode ? afe_dpi[17] : afe_dat_2_1;
+    wire [13:0] afe_dat_2_2_i = dpi_mode ? afe_dpi[18] : afe_dat_2_2;
+    wire [13:0] afe_dat_2_3_i = dpi_mode ? afe_dpi[19] : afe_dat_2_3;
+    wire [13:0] afe_dat_2_4_i = dpi_mode ? afe_dpi[20] : afe_dat_2_4;
+    wire [13:0] afe_dat_2_5_i = dpi_mode ? afe_dpi[21] : afe_dat_2_5;
+    wire [13:0] afe_dat_2_6_i = dpi_mode ? afe_dpi[22] : afe_dat_2_6;
+    wire [13:0] afe_dat_2_7_i = dpi_mode ? afe_dpi[23] : afe_dat_2_7;
+    wire [13:0] afe_dat_3_0_i = dpi_mode ? afe_dpi[24] : afe_dat_3_0;
+    wire [13:0] afe_dat_3_1_i = dpi_mode ? afe_dpi[25] : afe_dat_3_1;
+    wire [13:0] afe_dat_3_2_i = dpi_mode ? afe_dpi[26] : afe_dat_3_2;
+    wire [13:0] afe_dat_3_3_i = dpi_mode ? afe_dpi[27] : afe_dat_3_3;
+    wire [13:0] afe_dat_3_4_i = dpi_mode ? afe_dpi[28] : afe_dat_3_4;
+    wire [13:0] afe_dat_3_5_i = dpi_mode ? afe_dpi[29] : afe_dat_3_5;
+    wire [13:0] afe_dat_3_6_i = dpi_mode ? afe_dpi[30] : afe_dat_3_6;
+    wire [13:0] afe_dat_3_7_i = dpi_mode ? afe_dpi[31] : afe_dat_3_7;
+    wire [13:0] afe_dat_4_0_i = dpi_mode ? afe_dpi[32] : afe_dat_4_0;
+    wire [13:0] afe_dat_4_1_i = dpi_mode ? afe_dpi[33] : afe_dat_4_1;
+    wire [13:0] afe_dat_4_2_i = dpi_mode ? afe_dpi[34] : afe_dat_4_2;
+    wire [13:0] afe_dat_4_3_i = dpi_mode ? afe_dpi[35] : afe_dat_4_3;
+    wire [13:0] afe_dat_4_4_i = dpi_mode ? afe_dpi[36] : afe_dat_4_4;
+    wire [13:0] afe_dat_4_5_i = dpi_mode ? afe_dpi[37] : afe_dat_4_5;
+    wire [13:0] afe_dat_4_6_i = dpi_mode ? afe_dpi[38] : afe_dat_4_6;
+    wire [13:0] afe_dat_4_7_i = dpi_mode ? afe_dpi[39] : afe_dat_4_7;
+
+
+    st40_top st_wrapper(
+        .reset_aclk(reset_aclk),
+        .reset_fclk(reset_fclk),
+        .adhoc(adhoc),
+        .st_config(st_config),
+        .signal_delay(signal_delay),
+        .threshold_xc(threshold_xc),
+        .ti_trigger(ti_trigger),
+        .ti_trigger_stbr(ti_trigger_stbr),
+        .reset_st_counters(reset_st_counters),
+        .slot_id(slot_id),
+        .crate_id(crate_id),
+        .detector_id(detector_id),
+        .version_id(version_id),
+        .enable(enable),
+        .afe_comp_enable(afe_comp_enable),
+        .invert_enable(invert_enable),
+        .st_40_signals_enable_reg(st_40_signals_enable_reg),
+        .st_40_selftrigger_4_spybuffer(st_40_selftrigger_4_spybuffer),
+        .filter_output_selector(filter_output_selector),
+        .aclk(aclk_i),
+        .timestamp(timestamp_i),
+        .afe_dat_0_0(afe_dat_0_0_i),
+        .afe_dat_0_1(afe_dat_0_1_i),
+        .afe_dat_0_2(afe_dat_0_2_i),
+        .afe_dat_0_3(afe_dat_0_3_i),
+        .afe_dat_0_4(afe_dat_0_4_i),
+        .afe_dat_0_5(afe_dat_0_5_i),
+        .afe_dat_0_6(afe_dat_0_6_i),
+        .afe_dat_0_7(afe_dat_0_7_i),
+        .afe_dat_0_8(afe_dat_0_8),
+        .afe_dat_1_0(afe_dat_1_0_i),
+        .afe_dat_1_1(afe_dat_1_1_i),
+        .afe_dat_1_2(afe_dat_1_2_i),
+        .afe_dat_1_3(afe_dat_1_3_i),
+        .afe_dat_1_4(afe_dat_1_4_i),
+        .afe_dat_1_5(afe_dat_1_5_i),
+        .afe_dat_1_6(afe_dat_1_6_i),
+        .afe_dat_1_7(afe_dat_1_7_i),
+        .afe_dat_1_8(afe_dat_1_8),
+        .afe_dat_2_0(afe_dat_2_0_i),
+        .afe_dat_2_1(afe_dat_2_1_i),
+        .afe_dat_2_2(afe_dat_2_2_i),
+        .afe_dat_2_3(afe_dat_2_3_i),
+        .afe_dat_2_4(afe_dat_2_4_i),
+        .afe_dat_2_5(afe_dat_2_5_i),
+        .afe_dat_2_6(afe_dat_2_6_i),
+        .afe_dat_2_7(afe_dat_2_7_i),
+        .afe_dat_2_8(afe_dat_2_8),
+        .afe_dat_3_0(afe_dat_3_0_i),
+        .afe_dat_3_1(afe_dat_3_1_i),
+        .afe_dat_3_2(afe_dat_3_2_i),
+        .afe_dat_3_3(afe_dat_3_3_i),
+        .afe_dat_3_4(afe_dat_3_4_i),
+        .afe_dat_3_5(afe_dat_3_5_i),
+        .afe_dat_3_6(afe_dat_3_6_i),
+        .afe_dat_3_7(afe_dat_3_7_i),
+        .afe_dat_3_8(afe_dat_3_8),
+        .afe_dat_4_0(afe_dat_4_0_i),
+        .afe_dat_4_1(afe_dat_4_1_i),
+        .afe_dat_4_2(afe_dat_4_2_i),
+        .afe_dat_4_3(afe_dat_4_3_i),
+        .afe_dat_4_4(afe_dat_4_4_i),
+        .afe_dat_4_5(afe_dat_4_5_i),
+        .afe_dat_4_6(afe_dat_4_6_i),
+        .afe_dat_4_7(afe_dat_4_7_i),
+        .afe_dat_4_8(afe_dat_4_8),
+        .afe_dat_0_0_filtered(afe_dat_0_0_filtered),
+        .afe_dat_0_1_filtered(afe_dat_0_1_filtered),
+        .afe_dat_0_2_filtered(afe_dat_0_2_filtered),
+        .afe_dat_0_3_filtered(afe_dat_0_3_filtered),
+        .afe_dat_0_4_filtered(afe_dat_0_4_filtered),
+        .afe_dat_0_5_filtered(afe_dat_0_5_filtered),
+        .afe_dat_0_6_filtered(afe_dat_0_6_filtered),
+        .afe_dat_0_7_filtered(afe_dat_0_7_filtered),
+        .afe_dat_0_8_filtered(afe_dat_0_8_filtered),
+        .afe_dat_1_0_filtered(afe_dat_1_0_filtered),
+        .afe_dat_1_1_filtered(afe_dat_1_1_filtered),
+        .afe_dat_1_2_filtered(afe_dat_1_2_filtered),
+        .afe_dat_1_3_filtered(afe_dat_1_3_filtered),
+        .afe_dat_1_4_filtered(afe_dat_1_4_filtered),
+        .afe_dat_1_5_filtered(afe_dat_1_5_filtered),
+        .afe_dat_1_6_filtered(afe_dat_1_6_filtered),
+        .afe_dat_1_7_filtered(afe_dat_1_7_filtered),
+        .afe_dat_1_8_filtered(afe_dat_1_8_filtered),
+        .afe_dat_2_0_filtered(afe_dat_2_0_filtered),
+        .afe_dat_2_1_filtered(afe_dat_2_1_filtered),
+        .afe_dat_2_2_filtered(afe_dat_2_2_filtered),
+        .afe_dat_2_3_filtered(afe_dat_2_3_filtered),
+        .afe_dat_2_4_filtered(afe_dat_2_4_filtered),
+        .afe_dat_2_5_filtered(afe_dat_2_5_filtered),
+        .afe_dat_2_6_filtered(afe_dat_2_6_filtered),
+        .afe_dat_2_7_filtered(afe_dat_2_7_filtered),
+        .afe_dat_2_8_filtered(afe_dat_2_8_filtered),
+        .afe_dat_3_0_filtered(afe_dat_3_0_filtered),
+        .afe_dat_3_1_filtered(afe_dat_3_1_filtered),
+        .afe_dat_3_2_filtered(afe_dat_3_2_filtered),
+        .afe_dat_3_3_filtered(afe_dat_3_3_filtered),
+        .afe_dat_3_4_filtered(afe_dat_3_4_filtered),
+        .afe_dat_3_5_filtered(afe_dat_3_5_filtered),
+        .afe_dat_3_6_filtered(afe_dat_3_6_filtered),
+        .afe_dat_3_7_filtered(afe_dat_3_7_filtered),
+        .afe_dat_3_8_filtered(afe_dat_3_8_filtered),
+        .afe_dat_4_0_filtered(afe_dat_4_0_filtered),
+        .afe_dat_4_1_filtered(afe_dat_4_1_filtered),
+        .afe_dat_4_2_filtered(afe_dat_4_2_filtered),
+        .afe_dat_4_3_filtered(afe_dat_4_3_filtered),
+        .afe_dat_4_4_filtered(afe_dat_4_4_filtered),
+        .afe_dat_4_5_filtered(afe_dat_4_5_filtered),
+        .afe_dat_4_6_filtered(afe_dat_4_6_filtered),
+        .afe_dat_4_7_filtered(afe_dat_4_7_filtered),
+        .afe_dat_4_8_filtered(afe_dat_4_8_filtered),
+        .oeiclk(oeiclk_i),
+        .fclk(fclk_i),
+        .dout(dout),
+        .kout(kout),
+        .Rcount_addr(Rcount_addr),
+        .Rcount(Rcount)
+    );
+endmodule
\ No newline at end of file
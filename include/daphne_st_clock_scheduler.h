@@ -0,0 +1,58 @@
+#ifndef DAPHNE_ST_CLOCK_SCHEDULER_H
+#define DAPHNE_ST_CLOCK_SCHEDULER_H
+
+#include <queue>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace daphne_st_simulator{
+
+struct clock_edge{
+    uint64_t time;   // kernel time units since the scheduler was started
+    uint32_t clock;  // index returned by add_clock()
+    bool rising;
+};
+
+// Time-ordered queue of the edges of free-running clocks of arbitrary frequencies. Every clock
+// starts low at time 0 and its n-th edge (n = 1, 2, ...) comes at n * units_per_second / (2 * frequency),
+// rounded down to a kernel time unit. Edge times are computed from n, never accumulated, so clocks
+// whose periods are not a whole number of units do not drift against each other.
+class daphne_st_clock_scheduler{
+private:
+    struct clock{
+        uint64_t frequency;   // Hz
+        uint64_t next_edge;   // n of the edge in the queue
+    };
+    struct later{
+        bool operator()(const clock_edge &a, const clock_edge &b) const {
+            return a.time != b.time ? a.time > b.time : a.clock > b.clock;
+        }
+    };
+
+    uint64_t units_per_second = 1000000000000ULL; // 1 ps, the precision of elaborate.csh
+    std::vector<clock> clocks;
+    std::priority_queue<clock_edge, std::vector<clock_edge>, later> queue;
+    uint64_t time = 0;
+
+    uint64_t edge_time(const clock &c) const;
+
+public:
+    // Drops the clocks and restarts time at 0.
+    void reset(const uint64_t &units_per_second);
+    uint32_t add_clock(const uint64_t &frequency);
+    size_t get_number_of_clocks() const { return this->clocks.size(); }
+    uint64_t get_frequency(const uint32_t &clock) const { return this->clocks[clock].frequency; }
+
+    // Time of the edges applied last.
+    uint64_t get_time() const { return this->time; }
+    const clock_edge& peek() const { return this->queue.top(); }
+    uint64_t get_next_edge_time(const uint32_t &clock) const { return this->edge_time(this->clocks[clock]); }
+    // Moves every edge at the earliest pending time into edges (cleared first) and queues the
+    // following edge of each of those clocks. Returns the time to run the kernel until the next edge.
+    uint64_t pop_edges(std::vector<clock_edge> &edges);
+};
+
+}
+
+#endif // DAPHNE_ST_CLOCK_SCHEDULER_H
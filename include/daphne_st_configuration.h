@@ -0,0 +1,49 @@
+#ifndef DAPHNE_ST_CONFIGURATION_H
+#define DAPHNE_ST_CONFIGURATION_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+#include "nlohmann/json.hpp"
+
+namespace daphne_st_simulator{
+
+// Self-trigger settings of one DAPHNE, as found in the devices section of the DAQ configuration file.
+struct self_trigger_configuration{
+    uint16_t slot_id = 0;                  // slot
+    uint16_t crate_id = 0;                 // crate, 0 when the entry has none
+    uint16_t detector_id = 0;              // det_id, a number or a numeric string
+    std::vector<uint16_t> input_channels;  // self_trigger.enable_compensator, in file order; one input_data block per entry
+    uint64_t enabled_channels = 0;         // channels.indices
+    uint64_t enabled_compensator = 0;
+    uint64_t enabled_inverter = 0;         // self_trigger.enable_inverter
+    std::string filter_mode = "inverted";  // compensated, inverted, xcorr or raw
+    std::string slope_mode = "20";
+    uint32_t slope_threshold = 0;
+    uint32_t pedestal_length = 0;
+    uint32_t spybuffer_channel = 0;
+    uint64_t correlation_threshold = 0;
+    uint64_t discrimination_threshold = 0;
+
+    // Throws std::runtime_error / nlohmann::json exceptions on unreadable files or missing keys.
+    static self_trigger_configuration from_file(const std::string &configFile, const size_t &device_index = 0);
+    // One configuration per entry of the devices array.
+    static std::vector<self_trigger_configuration> devices_from_file(const std::string &configFile);
+    static self_trigger_configuration from_json(nlohmann::json &device);
+    // filter_output_selector value of filter_mode, throws std::invalid_argument for unknown modes.
+    uint32_t filter_output_selector() const;
+    void print(std::ostream &os) const;
+};
+
+// Configuration written from input sample sample_index of a run_simulation() on, without resetting the
+// design. input_channels must match the configuration the run started with; everything else may change.
+struct configuration_change{
+    uint64_t sample_index = 0;
+    self_trigger_configuration configuration;
+};
+
+}
+
+#endif // DAPHNE_ST_CONFIGURATION_H
@@ -0,0 +1,48 @@
+#ifndef DAPHNE_ST_COUNTERS_H
+#define DAPHNE_ST_COUNTERS_H
+
+#include <array>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+namespace daphne_st_simulator{
+
+// One pass over the Rcount_addr map of st40_top. Counters are indexed by the STC input 8*afe + channel.
+struct counter_snapshot{
+    uint64_t sample_index = 0;   // input sample at which the pass started
+    uint64_t timestamp = 0;      // timestamp port value at that point
+    bool end_of_run = false;     // taken after the input ended (see daphne_st_top_hdl_simulator::set_counter_readout)
+    std::array<uint64_t, 40> trigger_count{};  // TCount, 0x40800000 + 8*input
+    std::array<uint64_t, 40> packet_count{};   // PCount, 0x40800140 + 8*input
+    uint64_t send_count = 0;                   // sendCount, 0x40800280
+};
+
+struct counter_metrics{
+    double seconds = 0.0;                      // stimulus length at 62.5 MHz
+    std::array<double, 40> trigger_rate{};     // Hz
+    std::array<double, 40> packet_trigger_ratio{}; // below 1 when fifo_af back-pressure dropped frames
+    uint64_t triggers = 0;
+    uint64_t packets = 0;
+    uint64_t sent = 0;
+    double link_efficiency = 0.0;              // frames sent on the link / frames built
+
+    // From the last snapshot of a run over n_samples samples, for the inputs set in enabled_inputs.
+    static counter_metrics from_snapshot(const counter_snapshot &snapshot, const uint64_t &n_samples, const uint64_t &enabled_inputs);
+    void print_summary(std::ostream &os, const uint64_t &enabled_inputs) const;
+};
+
+// Rcount_addr of the n-th counter of a readout pass: 40 trigger counters, 40 packet counters, sendCount.
+constexpr uint32_t counter_readout_addresses = 81;
+inline uint32_t counter_readout_address(const uint32_t &n){
+    if(n < 40) return 0x40800000 + 8 * n;
+    if(n < 80) return 0x40800140 + 8 * (n - 40);
+    return 0x40800280;
+}
+
+// One row per snapshot: sample_index, timestamp, end_of_run, trigger_0..39, packet_0..39, send_count.
+void write_counter_series_csv(std::ostream &os, const std::vector<counter_snapshot> &series);
+
+}
+
+#endif // DAPHNE_ST_COUNTERS_H
@@ -0,0 +1,59 @@
+#ifndef DAPHNE_ST_CRATE_H
+#define DAPHNE_ST_CRATE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "fddetdataformats/DAPHNEFrame.hpp"
+#include "daphne_st_configuration.h"
+#include "daphne_st_worker_pool.h"
+
+namespace daphne_st_simulator{
+
+// One frame of the crate-level stream and the device (index in the devices array) that sent it.
+struct crate_frame{
+    uint16_t device_index;
+    dunedaq::fddetdataformats::DAPHNEFrame frame;
+};
+
+struct crate_device_report{
+    bool ok = false;            // false if the device's worker failed before finishing
+    uint64_t frames = 0;
+    uint64_t malformed_frames = 0;
+    double seconds = 0.0;
+};
+
+// Simulates every DAPHNE of a multi-device DAQ configuration, each with its own simulator
+// instance (slot_id, crate_id and detector_id driven from its entry) in a worker process,
+// and merges the frames of all devices by timestamp into one crate-level stream.
+class daphne_st_crate{
+private:
+    std::string design_libname;
+    std::string simkernel_libname;
+    std::vector<self_trigger_configuration> devices;
+    std::vector<crate_device_report> device_reports;
+    uint64_t clk_sim_step = 4000;
+    unsigned int n_workers = 0; // 0 = std::thread::hardware_concurrency()
+
+    void run_worker(const std::vector<std::vector<uint16_t>> &inputs,
+                    const daphne_st_worker_pool::next_task_function &next_task, const daphne_st_worker_pool::send_function &send);
+
+public:
+    daphne_st_crate(const std::string &design_libname, const std::string &simkernel_libname, const std::vector<self_trigger_configuration> &devices);
+    // Every entry of the devices array of a DAQ configuration file.
+    daphne_st_crate(const std::string &design_libname, const std::string &simkernel_libname, const std::string &configFile);
+    void set_number_of_workers(const unsigned int &n_workers) { this->n_workers = n_workers; }
+    void set_clk_sim_step(const uint64_t &clk_sim_step) { this->clk_sim_step = clk_sim_step; }
+    const std::vector<self_trigger_configuration>& get_devices() const { return this->devices; }
+    // inputs[d] is channel-major over devices[d].input_channels, as for run_simulation();
+    // a single entry is used for every device. Frames come back ordered by timestamp, then device, then channel.
+    std::vector<crate_frame> run(const std::vector<std::vector<uint16_t>> &inputs);
+    const std::vector<crate_device_report>& get_device_reports() const { return this->device_reports; }
+    // Back to back DAPHNEFrame records, the format read by daphne_st_frame_reader.
+    static void write_frames(const std::string &filename, const std::vector<crate_frame> &frames);
+};
+
+}
+
+#endif // DAPHNE_ST_CRATE_H
@@ -0,0 +1,58 @@
+#ifndef DAPHNE_ST_CSV_LOADER_H
+#define DAPHNE_ST_CSV_LOADER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+namespace daphne_st_simulator{
+
+// One rejected value of the CSV file.
+struct csv_value_error{
+    enum reason_type : uint8_t { malformed = 0, out_of_range = 1, missing_columns = 2, extra_columns = 3 };
+    uint64_t line;   // 1-based line number in the file
+    uint16_t column; // 0-based column index
+    reason_type reason;
+};
+
+// Bulk report of a load. Bad values are stored as 0 in the output buffer and
+// counted here; only the first max_reported_errors of them are kept verbatim.
+struct csv_load_report{
+    uint64_t rows = 0;
+    uint16_t columns = 0;
+    uint64_t malformed_values = 0;
+    uint64_t out_of_range_values = 0;
+    uint64_t bad_rows = 0; // rows with a column count different from the first data row
+    std::vector<csv_value_error> errors;
+
+    bool ok() const { return this->malformed_values == 0 && this->out_of_range_values == 0 && this->bad_rows == 0; }
+    void print_summary(std::ostream &os) const;
+};
+
+// Loads an integer CSV file (one row per sample, one column per channel) into the
+// channel-major buffer expected by run_simulation(): buffer[channel*rows + row].
+// The file is memory mapped, split into chunks on newline boundaries and the chunks
+// are parsed on a pool of worker threads with a SWAR (8 digits per step) parser.
+class daphne_st_csv_loader{
+private:
+    std::string filename;
+    bool skip_header = false;
+    unsigned int n_threads = 0; // 0 = std::thread::hardware_concurrency()
+    uint32_t max_value = 0xFFFF;
+    size_t max_reported_errors = 64;
+
+public:
+    daphne_st_csv_loader(const std::string &filename, const bool &skip_header = false);
+    void set_number_of_threads(const unsigned int &n_threads) { this->n_threads = n_threads; }
+    void set_max_value(const uint32_t &max_value) { this->max_value = max_value; }
+    void set_max_reported_errors(const size_t &max_reported_errors) { this->max_reported_errors = max_reported_errors; }
+    // Fills channel_major with n_channels channels. The file must have either
+    // n_channels columns or a single column, which is then broadcast to every channel.
+    // n_channels = 0 takes the number of columns of the file.
+    csv_load_report load(std::vector<uint16_t> &channel_major, const size_t &n_channels = 0) const;
+};
+
+}
+
+#endif // DAPHNE_ST_CSV_LOADER_H
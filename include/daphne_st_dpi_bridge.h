@@ -0,0 +1,53 @@
+#ifndef DAPHNE_ST_DPI_BRIDGE_H
+#define DAPHNE_ST_DPI_BRIDGE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace daphne_st_simulator{
+
+// A non-idle output word and the fclk cycle (counted from dpi_mode rising) it was on dout.
+struct dpi_output_word{
+    uint64_t cycle;
+    uint32_t word;
+    uint32_t k;
+};
+
+// Buffers behind the DPI-C functions imported by hdl_files/trig/st40_top_dpi_wrapper.sv.
+// XSim calls them from inside run(), on the thread that called it, so the bridge in use is
+// installed per thread and one process can drive several designs from different threads.
+class daphne_st_dpi_bridge{
+private:
+    const uint16_t* input_data = nullptr;  // channel-major, as passed to run_simulation()
+    size_t length = 0;                     // samples per channel
+    size_t position = 0;                   // next sample to hand to the wrapper
+    std::vector<uint16_t> input_slots;     // STC input (8*afe + channel) of each channel of input_data
+    std::vector<dpi_output_word> words;    // pushed during run(), drained by the simulator after it; the storage is reused
+
+    static thread_local daphne_st_dpi_bridge* active;
+
+public:
+    void set_input(const uint16_t* input_data, const size_t &length, const std::vector<uint16_t> &channels);
+    bool input_done() const { return this->position == this->length; }
+    size_t get_position() const { return this->position; }
+    std::vector<dpi_output_word>& get_words() { return this->words; }
+
+    // Up to max_samples rows of 40 inputs; inputs without data stay at 0 like the unused ports.
+    int fetch_block(int16_t* block, const int &max_samples);
+    void push_word(const uint64_t &cycle, const uint32_t &word, const uint32_t &k) { this->words.push_back({cycle, word, k}); }
+
+    void install() { active = this; }
+    static void uninstall() { active = nullptr; }
+    static daphne_st_dpi_bridge* get_active() { return active; }
+};
+
+}
+
+// Called by XSim; the names and signatures match the imports of st40_top_dpi_wrapper.sv.
+extern "C" {
+int daphne_st_dpi_fetch_block(short* block, int max_samples);
+void daphne_st_dpi_push_word(unsigned long long cycle, unsigned int word, unsigned int k);
+}
+
+#endif // DAPHNE_ST_DPI_BRIDGE_H
@@ -0,0 +1,113 @@
+#ifndef DAPHNE_ST_EVENT_LOG_H
+#define DAPHNE_ST_EVENT_LOG_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+namespace daphne_st_simulator{
+
+enum class event_level : uint8_t { debug, info, warning, error };
+enum class event_type : uint8_t { sof, eof, idle_timeout, config, run_start, run_end, drained, external_trigger };
+enum class event_log_format { json_lines, binary };
+
+// One log entry. cycle is the index of the dout word (fclk cycle) the event refers to, counted
+// since the stream was cleared, idles included, for every type; the meaning of value depends on
+// the type (packet number, enabled channel mask...). Binary logs are these 32 bytes as they are
+// in memory (little endian), reserved always zero.
+struct event_record{
+    uint64_t time_ns;
+    uint64_t cycle;
+    uint64_t value;
+    event_type type;
+    event_level level;
+    uint8_t reserved[6] = {};
+};
+static_assert(sizeof(event_record) == 32, "binary event log records are 32 bytes");
+
+// Bounded lock-free multi-producer queue of event_record (Vyukov's sequence-numbered ring)
+// drained by a background thread into a JSON-lines or binary file. log() never blocks and
+// never allocates: when the queue is full the event is dropped and counted, so the
+// simulation threads are never held up by the file system.
+class daphne_st_event_log{
+private:
+    struct cell{
+        std::atomic<size_t> sequence;
+        event_record record;
+    };
+
+    std::vector<cell> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_position{0};
+    alignas(64) std::atomic<size_t> dequeue_position{0};
+    alignas(64) std::atomic<uint64_t> dropped_events{0};
+    std::atomic<bool> active{false};
+    std::atomic<bool> stop{false};
+    event_level min_level = event_level::info;
+    event_log_format format = event_log_format::json_lines;
+    std::chrono::steady_clock::time_point start_time;
+    std::ofstream output;
+    std::thread drain_thread;
+    uint64_t written_events = 0;
+
+    bool dequeue(event_record &record);
+    void write_record(const event_record &record);
+    void drain();
+
+public:
+    explicit daphne_st_event_log(const size_t &capacity = 1 << 16);
+    ~daphne_st_event_log();
+    daphne_st_event_log(const daphne_st_event_log&) = delete;
+    daphne_st_event_log& operator=(const daphne_st_event_log&) = delete;
+
+    // Starts draining into filename. Events below min_level are discarded at the source.
+    void open(const std::string &filename, const event_log_format &format = event_log_format::json_lines,
+              const event_level &min_level = event_level::info);
+    // Stops the drain thread after writing every queued event.
+    void close();
+    bool is_open() const { return this->active.load(std::memory_order_relaxed); }
+
+    void log(const event_type &type, const event_level &level, const uint64_t &cycle, const uint64_t &value){
+        if(!this->active.load(std::memory_order_relaxed) || level < this->min_level){
+            return;
+        }
+        size_t position = this->enqueue_position.load(std::memory_order_relaxed);
+        cell* c;
+        for(;;){
+            c = &this->cells[position & this->mask];
+            size_t sequence = c->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if(difference == 0){
+                if(this->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }else if(difference < 0){
+                this->dropped_events.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }else{
+                position = this->enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+        c->record.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start_time).count();
+        c->record.cycle = cycle;
+        c->record.value = value;
+        c->record.type = type;
+        c->record.level = level;
+        c->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    uint64_t get_dropped_events() const { return this->dropped_events.load(std::memory_order_relaxed); }
+    uint64_t get_written_events() const { return this->written_events; }
+
+    static const char* level_name(const event_level &level);
+    static const char* type_name(const event_type &type);
+};
+
+}
+
+#endif // DAPHNE_ST_EVENT_LOG_H
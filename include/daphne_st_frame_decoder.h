@@ -0,0 +1,92 @@
+#ifndef DAPHNE_ST_FRAME_DECODER_H
+#define DAPHNE_ST_FRAME_DECODER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "fddetdataformats/DAPHNEFrame.hpp"
+
+namespace daphne_st_simulator{
+
+// Role of a dout word in the framing. Only words whose kout marks byte 0 as a K character
+// are markers, so payload words that happen to end in 0x3C or 0xDC are never taken for one.
+enum class frame_marker : uint8_t { none, sof, eof };
+
+inline frame_marker classify_word(const uint32_t &word, const uint32_t &kout){
+    if((kout & 1) == 0){
+        return frame_marker::none;
+    }
+    if((word & 0xFF) == 0x3C){
+        return frame_marker::sof;
+    }
+    if((word & 0xFF) == 0xDC){
+        return frame_marker::eof;
+    }
+    return frame_marker::none;
+}
+
+// Same without kout, for streams captured without it: any word ending in 0x3C / 0xDC.
+inline frame_marker classify_word(const uint32_t &word){
+    return classify_word(word, 1);
+}
+
+// Incremental decoder of the st40_top output link. A frame on the link is
+// SOF (K28.1, 0x3C) + 466 payload words + EOF (K28.6, 0xDC); the payload maps one to
+// one onto DAPHNEFrame (DAQHeader, Header, 448 packed ADC words, 13 trailer words).
+class daphne_st_frame_decoder{
+public:
+    using frame_type = dunedaq::fddetdataformats::DAPHNEFrame;
+    static constexpr size_t payload_words = sizeof(frame_type) / sizeof(uint32_t);
+
+private:
+    std::vector<frame_type> frames;
+    frame_type current;
+    size_t words_in_frame = 0;
+    bool in_frame = false;
+    uint64_t malformed_frames = 0; // payload cut short by an SOF or not followed by an EOF word
+
+public:
+    // Feeds one dout word and its marker, e.g. from the writer stage of run_simulation().
+    void push(const uint32_t &word, const frame_marker &marker){
+        if(marker == frame_marker::sof){
+            if(this->in_frame){
+                this->malformed_frames++;
+            }
+            this->in_frame = true;
+            this->words_in_frame = 0;
+            return;
+        }
+        if(!this->in_frame){
+            return;
+        }
+        if(this->words_in_frame < payload_words){
+            reinterpret_cast<uint32_t*>(&this->current)[this->words_in_frame++] = word;
+            return;
+        }
+        if(marker == frame_marker::eof){
+            this->frames.push_back(this->current);
+        }else{
+            this->malformed_frames++;
+        }
+        this->in_frame = false;
+    }
+    void push(const uint32_t* words, const frame_marker* markers, const size_t &n_words);
+    // Without kout, only the first SOF-looking word of each frame starts one.
+    void push(const uint32_t &word){
+        frame_marker marker = classify_word(word);
+        this->push(word, this->in_frame && marker == frame_marker::sof ? frame_marker::none : marker);
+    }
+    void push(const uint32_t* words, const size_t &n_words);
+    std::vector<frame_type>& get_frames() { return this->frames; }
+    const std::vector<frame_type>& get_frames() const { return this->frames; }
+    uint64_t get_malformed_frames() const { return this->malformed_frames; }
+    void reset();
+
+    // Decodes a whole captured stream at once.
+    static std::vector<frame_type> decode(const std::vector<uint32_t> &stream);
+};
+
+}
+
+#endif // DAPHNE_ST_FRAME_DECODER_H
@@ -0,0 +1,94 @@
+#ifndef DAPHNE_ST_FRAME_READER_H
+#define DAPHNE_ST_FRAME_READER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <cstdint>
+
+#include "fddetdataformats/DAPHNEFrame.hpp"
+#include "daphne_st_input_source.h"
+#include "daphne_st_mapped_file.h"
+
+namespace daphne_st_simulator{
+
+struct frame_load_report{
+    uint64_t frames_in_file = 0;
+    uint64_t frames_used = 0;
+    uint64_t frames_outside_window = 0;
+    uint64_t frames_unselected_channel = 0;
+    uint64_t overlapping_samples = 0; // samples dropped because an earlier frame already covered them
+    uint64_t gap_samples = 0;         // samples filled with the pedestal
+    uint64_t trailing_bytes = 0;      // incomplete record at the end of the file
+    uint64_t first_timestamp = 0;     // timestamp of sample 0 of the output buffer
+    uint64_t samples_per_channel = 0;
+
+    void print_summary(std::ostream &os) const;
+};
+
+// A frame that feeds one output channel: its samples [skip, 1024) land at start + skip onwards,
+// start counted from frame_load_report::first_timestamp. Earlier frames already cover [0, skip).
+struct frame_segment{
+    uint64_t start;
+    const dunedaq::fddetdataformats::DAPHNEFrame* frame;
+    uint32_t skip;
+};
+
+// Replays a binary dump of DAPHNEFrame records (back to back, sizeof(DAPHNEFrame) each)
+// as stimulus. Frames are grouped by get_channel(), ordered by get_timestamp() and unpacked
+// into the channel-major buffer expected by run_simulation(). One timestamp tick is one
+// 62.5 MHz sample; samples not covered by any frame are filled with the pedestal.
+// load() holds the whole span, gaps included, in memory; open_source() only indexes the frames
+// and unpacks them as run_simulation() reads, for dumps whose span does not fit in RAM.
+class daphne_st_frame_reader{
+private:
+    using frame_type = dunedaq::fddetdataformats::DAPHNEFrame;
+
+    std::string filename;
+    uint16_t pedestal = 8192;
+    uint64_t window_begin = 0;
+    uint64_t window_end = UINT64_MAX;
+    unsigned int n_threads = 0; // 0 = std::thread::hardware_concurrency()
+
+    // Selects, orders and de-overlaps the frames of each output channel, filling every report field.
+    frame_load_report index_frames(const daphne_st_mapped_file &file, const std::vector<uint16_t> &channels,
+                                   std::vector<std::vector<frame_segment>> &segments) const;
+
+public:
+    daphne_st_frame_reader(const std::string &filename);
+    void set_pedestal(const uint16_t &pedestal) { this->pedestal = pedestal; }
+    // Only frames starting inside [begin, end) are used, so long recordings can be replayed in slices.
+    void set_time_window(const uint64_t &begin, const uint64_t &end) { this->window_begin = begin; this->window_end = end; }
+    void set_number_of_threads(const unsigned int &n_threads) { this->n_threads = n_threads; }
+    // channels[i] is the frame channel (get_channel()) that feeds output channel i, normally
+    // in the same order as daphne_st_top_hdl_simulator::get_enabled_channels().
+    frame_load_report load(std::vector<uint16_t> &channel_major, const std::vector<uint16_t> &channels) const;
+    // Same stimulus as load(), as a source that keeps the file mapped and unpacks frames on read().
+    // Memory is the frame index, 24 bytes per used frame, however long the gaps are.
+    frame_load_report open_source(input_source_ptr &source, const std::vector<uint16_t> &channels) const;
+
+    // Unpacks the 1024 densely packed 14-bit samples of one frame.
+    static void unpack_adc_words(const frame_type::word_t* adc_words, uint16_t* samples);
+};
+
+// Input source over an indexed dump, built by daphne_st_frame_reader::open_source().
+class daphne_st_frame_source : public daphne_st_input_source{
+private:
+    std::shared_ptr<const daphne_st_mapped_file> file;
+    std::vector<std::vector<frame_segment>> segments; // per output channel, in start order
+    uint64_t length;
+    uint16_t pedestal;
+
+public:
+    daphne_st_frame_source(std::shared_ptr<const daphne_st_mapped_file> file, std::vector<std::vector<frame_segment>> segments,
+                           const uint64_t &length, const uint16_t &pedestal)
+        : file(std::move(file)), segments(std::move(segments)), length(length), pedestal(pedestal) {}
+    size_t get_number_of_channels() const override { return this->segments.size(); }
+    uint64_t get_length() const override { return this->length; }
+    void read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const override;
+};
+
+}
+
+#endif // DAPHNE_ST_FRAME_READER_H
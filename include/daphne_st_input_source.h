@@ -0,0 +1,106 @@
+#ifndef DAPHNE_ST_INPUT_SOURCE_H
+#define DAPHNE_ST_INPUT_SOURCE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace daphne_st_simulator{
+
+// Input of run_simulation(): get_number_of_channels() channels, one per enabled input in
+// get_enabled_channels() order, of get_length() samples each. The loader stage reads it one block
+// at a time, so a source only has to produce the samples asked for; the descriptors below generate
+// them from a few KB of templates instead of a channel-major copy of the whole run.
+class daphne_st_input_source{
+public:
+    virtual ~daphne_st_input_source() = default;
+    virtual size_t get_number_of_channels() const = 0;
+    virtual uint64_t get_length() const = 0;
+    // Writes samples [first, first + count) of channel to out. The range is within get_length().
+    virtual void read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const = 0;
+};
+
+typedef std::shared_ptr<const daphne_st_input_source> input_source_ptr;
+
+// Channel-major samples, data[channel*length + i], as taken by run_simulation(const std::vector<uint16_t>&).
+// The first constructor keeps a pointer only: data must outlive the source.
+class daphne_st_buffer_source : public daphne_st_input_source{
+private:
+    std::shared_ptr<const std::vector<uint16_t>> owned;
+    const uint16_t* data;
+    size_t n_channels;
+    uint64_t length;
+
+public:
+    daphne_st_buffer_source(const uint16_t* data, const size_t &n_channels, const uint64_t &length)
+        : data(data), n_channels(n_channels), length(length) {}
+    // Throws std::invalid_argument if the size of data is not a multiple of n_channels.
+    daphne_st_buffer_source(std::vector<uint16_t> data, const size_t &n_channels);
+    size_t get_number_of_channels() const override { return this->n_channels; }
+    uint64_t get_length() const override { return this->length; }
+    void read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const override;
+};
+
+// Constant baseline, e.g. a pedestal gap between pulses.
+class daphne_st_pedestal_source : public daphne_st_input_source{
+private:
+    size_t n_channels;
+    uint64_t length;
+    uint16_t value;
+
+public:
+    daphne_st_pedestal_source(const uint16_t &value, const uint64_t &length, const size_t &n_channels = 1)
+        : n_channels(n_channels), length(length), value(value) {}
+    size_t get_number_of_channels() const override { return this->n_channels; }
+    uint64_t get_length() const override { return this->length; }
+    void read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const override;
+};
+
+// segment played count times back to back.
+class daphne_st_repeat_source : public daphne_st_input_source{
+private:
+    input_source_ptr segment;
+    uint64_t count;
+
+public:
+    // Throws std::invalid_argument for a null segment.
+    daphne_st_repeat_source(input_source_ptr segment, const uint64_t &count);
+    size_t get_number_of_channels() const override { return this->segment->get_number_of_channels(); }
+    uint64_t get_length() const override { return this->segment->get_length() * this->count; }
+    void read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const override;
+};
+
+// Channel 0 of waveform on each of n_channels channels.
+class daphne_st_broadcast_source : public daphne_st_input_source{
+private:
+    input_source_ptr waveform;
+    size_t n_channels;
+
+public:
+    // Throws std::invalid_argument for a null waveform.
+    daphne_st_broadcast_source(input_source_ptr waveform, const size_t &n_channels);
+    size_t get_number_of_channels() const override { return this->n_channels; }
+    uint64_t get_length() const override { return this->waveform->get_length(); }
+    void read(const size_t & /*channel*/, const uint64_t &first, const size_t &count, uint16_t* out) const override {
+        this->waveform->read(0, first, count, out);
+    }
+};
+
+// Segments one after the other, all with the same number of channels.
+class daphne_st_concat_source : public daphne_st_input_source{
+private:
+    std::vector<input_source_ptr> segments;
+    std::vector<uint64_t> segment_end; // running sum of the segment lengths
+
+public:
+    // Throws std::invalid_argument for no segments, a null one or one with a different number of channels.
+    explicit daphne_st_concat_source(std::vector<input_source_ptr> segments);
+    size_t get_number_of_channels() const override { return this->segments.front()->get_number_of_channels(); }
+    uint64_t get_length() const override { return this->segment_end.back(); }
+    void read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const override;
+};
+
+}
+
+#endif // DAPHNE_ST_INPUT_SOURCE_H
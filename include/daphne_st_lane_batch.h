@@ -0,0 +1,61 @@
+#ifndef DAPHNE_ST_LANE_BATCH_H
+#define DAPHNE_ST_LANE_BATCH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "fddetdataformats/DAPHNEFrame.hpp"
+#include "daphne_st_configuration.h"
+
+namespace daphne_st_simulator{
+
+class daphne_st_top_hdl_simulator;
+
+// A single-channel experiment: one waveform and the filter bits of the lane it runs on.
+struct lane_experiment{
+    std::vector<uint16_t> waveform;
+    bool compensator = false; // afe_comp_enable
+    bool inverter = false;    // invert_enable
+};
+
+struct lane_result{
+    uint16_t input = 0;      // STC input 8*afe + channel the experiment ran on
+    uint8_t channel_id = 0;  // 10*afe + channel, as in its frames
+    std::vector<dunedaq::fddetdataformats::DAPHNEFrame> frames;
+};
+
+// Packs up to 40 independent experiments into the afe_dat lanes of st40_top so one run does the
+// work of 40 single-channel ones. Experiment n runs on input n. Only afe_comp_enable and invert_enable
+// are per lane; filter mode, thresholds and pedestal length are shared by the whole design and
+// come from the base configuration. The STCs do not interact, except through the output link:
+// at high trigger rates the lanes compete for it and fifo_af back-pressure can drop frames that a
+// run on its own would have kept. Check counter_metrics::packet_trigger_ratio when that matters.
+class daphne_st_lane_batch{
+private:
+    self_trigger_configuration base;
+    std::vector<lane_experiment> experiments;
+
+public:
+    static constexpr size_t max_lanes = 40;
+
+    explicit daphne_st_lane_batch(const self_trigger_configuration &base) : base(base) {}
+    // Returns the lane of the experiment. Throws std::length_error when the 40 lanes are taken and
+    // std::invalid_argument for an empty waveform.
+    size_t add(const lane_experiment &experiment);
+    size_t get_number_of_lanes() const { return this->experiments.size(); }
+    void clear() { this->experiments.clear(); }
+
+    // The base configuration with one enabled input per lane and the lanes' filter bits.
+    self_trigger_configuration lane_configuration() const;
+    // Channel-major input for lane_configuration(); shorter waveforms hold their last sample up to the longest.
+    std::vector<uint16_t> lane_input() const;
+    // Applies lane_configuration(), runs lane_input() and hands each experiment the frames of its channel.
+    std::vector<lane_result> run(daphne_st_top_hdl_simulator &simulator) const;
+    // Frames of the first n_lanes lanes by channel id; frames of other channels are dropped.
+    static std::vector<lane_result> demultiplex(const std::vector<dunedaq::fddetdataformats::DAPHNEFrame> &frames, const size_t &n_lanes);
+};
+
+}
+
+#endif // DAPHNE_ST_LANE_BATCH_H
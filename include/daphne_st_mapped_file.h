@@ -0,0 +1,57 @@
+#ifndef DAPHNE_ST_MAPPED_FILE_H
+#define DAPHNE_ST_MAPPED_FILE_H
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace daphne_st_simulator{
+
+// Read-only memory mapping of a whole file, used by the stimulus readers.
+class daphne_st_mapped_file{
+private:
+    const char* file_data = nullptr;
+    size_t file_size = 0;
+
+public:
+    daphne_st_mapped_file(const std::string &filename, const int &advice = MADV_SEQUENTIAL){
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0){
+            throw std::runtime_error("Error opening file: " + filename);
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0){
+            ::close(fd);
+            throw std::runtime_error("Error reading size of file: " + filename);
+        }
+        this->file_size = st.st_size;
+        if(this->file_size > 0){
+            void* ptr = mmap(nullptr, this->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(ptr == MAP_FAILED){
+                ::close(fd);
+                throw std::runtime_error("Error mapping file: " + filename);
+            }
+            madvise(ptr, this->file_size, advice);
+            this->file_data = static_cast<const char*>(ptr);
+        }
+        ::close(fd);
+    }
+    ~daphne_st_mapped_file(){
+        if(this->file_data != nullptr){
+            munmap(const_cast<char*>(this->file_data), this->file_size);
+        }
+    }
+    daphne_st_mapped_file(const daphne_st_mapped_file&) = delete;
+    daphne_st_mapped_file& operator=(const daphne_st_mapped_file&) = delete;
+
+    const char* data() const { return this->file_data; }
+    size_t size() const { return this->file_size; }
+};
+
+}
+
+#endif // DAPHNE_ST_MAPPED_FILE_H
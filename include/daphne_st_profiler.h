@@ -0,0 +1,103 @@
+#ifndef DAPHNE_ST_PROFILER_H
+#define DAPHNE_ST_PROFILER_H
+
+#include <string>
+#include <ostream>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+// Build with -DDAPHNE_ST_SIM_PROFILING to compile the timers and XSI call counters in.
+// Without it the profiling macros expand to nothing and the hot path is unchanged.
+#ifdef DAPHNE_ST_SIM_PROFILING
+#define DAPHNE_ST_PROFILE_CONCAT_IMPL(a, b) a##b
+#define DAPHNE_ST_PROFILE_CONCAT(a, b) DAPHNE_ST_PROFILE_CONCAT_IMPL(a, b)
+#define DAPHNE_ST_PROFILE_SCOPE(profiler, phase) \
+    daphne_st_simulator::daphne_st_scoped_timer DAPHNE_ST_PROFILE_CONCAT(daphne_st_profile_timer_, __LINE__)(profiler, phase)
+#else
+#define DAPHNE_ST_PROFILE_SCOPE(profiler, phase) do{}while(0)
+#endif
+
+namespace daphne_st_simulator{
+
+// Per-phase call counts and rdtsc ticks of run_simulation(). Every phase is only ever
+// updated by one thread (kernel, loader or writer stage), so the counters are plain integers
+// and are read once the stages have been joined.
+class daphne_st_profiler{
+public:
+    enum phase : size_t{
+        run_simulation,   // whole call, kernel thread
+        xsi_run,          // loader->run()
+        xsi_put_value,    // loader->put_value()
+        xsi_get_value,    // loader->get_value()
+        input_wait,       // kernel waiting for the loader stage
+        output_wait,      // kernel waiting for the writer stage
+        drain,            // stepping after the input ended until the end of stream
+        load_input,       // loader stage gathering and transposing samples
+        write_output,     // writer stage storing and decoding words
+        number_of_phases
+    };
+
+private:
+    uint64_t calls[number_of_phases] = {};
+    uint64_t ticks[number_of_phases] = {};
+    uint64_t samples = 0;
+    uint64_t fclk_cycles = 0;
+    double run_seconds = 0.0;
+    uint64_t start_ticks = 0;
+    std::chrono::steady_clock::time_point start_time;
+
+public:
+    static uint64_t now(){
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void add(const phase &p, const uint64_t &elapsed){
+        this->calls[p]++;
+        this->ticks[p] += elapsed;
+    }
+
+    // Bracket one run_simulation(); the tick rate is calibrated against the wall clock of the run.
+    void begin_run();
+    void end_run(const uint64_t &samples, const uint64_t &fclk_cycles);
+    void reset();
+
+    static const char* phase_name(const phase &p);
+    double ticks_per_second() const;
+    double seconds(const phase &p) const;
+    uint64_t get_calls(const phase &p) const { return this->calls[p]; }
+    uint64_t get_ticks(const phase &p) const { return this->ticks[p]; }
+    double samples_per_second() const;
+    double fclk_cycles_per_second() const;
+
+    void print_summary(std::ostream &os) const;
+    nlohmann::json to_json() const;
+    void write_json(const std::string &filename) const;
+};
+
+class daphne_st_scoped_timer{
+private:
+    daphne_st_profiler &profiler;
+    daphne_st_profiler::phase p;
+    uint64_t start;
+
+public:
+    daphne_st_scoped_timer(daphne_st_profiler &profiler, const daphne_st_profiler::phase &p) : profiler(profiler), p(p), start(daphne_st_profiler::now()) {}
+    ~daphne_st_scoped_timer() { this->profiler.add(this->p, daphne_st_profiler::now() - this->start); }
+    daphne_st_scoped_timer(const daphne_st_scoped_timer&) = delete;
+    daphne_st_scoped_timer& operator=(const daphne_st_scoped_timer&) = delete;
+};
+
+}
+
+#endif // DAPHNE_ST_PROFILER_H
@@ -0,0 +1,89 @@
+#ifndef DAPHNE_ST_SIGNAL_TRACER_H
+#define DAPHNE_ST_SIGNAL_TRACER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <deque>
+#include <cstdint>
+
+#include "xsi.h"
+
+namespace daphne_st_simulator{
+
+// all: every cycle. cycle_range: [first, last) run cycles of each run.
+// around_trigger: pre run cycles before and post run cycles after every trigger.
+enum class trace_window_mode { all, cycle_range, around_trigger };
+
+// Writes the values of a few signals, one point per fclk cycle, to a VCD file. Only changes are
+// written; cycles outside the window are skipped and shown as x, so a trace stays small however
+// long the run is. Values are s_xsi_vlog_logicval words as returned by get_value().
+class daphne_st_signal_tracer{
+private:
+    struct signal{
+        std::string name;
+        uint16_t width;
+        size_t first_word;
+        std::string id;
+    };
+
+    std::vector<signal> signals;
+    size_t words_per_cycle = 0;
+    std::ofstream output;
+    bool header_written = false;
+    uint64_t ns_per_cycle = 8; // fclk, 125 MHz
+
+    trace_window_mode mode = trace_window_mode::all;
+    uint64_t first_cycle = 0;
+    uint64_t last_cycle = UINT64_MAX;
+    uint64_t pre_cycles = 0;
+    uint64_t post_cycles = 0;
+
+    // around_trigger: the records of the last pre_cycles run cycles, written out when a trigger comes
+    std::deque<s_xsi_vlog_logicval> history;
+    std::deque<uint64_t> history_cycle;
+    std::deque<uint64_t> history_run_cycle;
+    std::vector<s_xsi_vlog_logicval> history_record; // one record of history, contiguous for write_cycle()
+    uint64_t record_until = 0;   // run cycle
+    uint64_t last_run_cycle = 0;
+
+    std::vector<s_xsi_vlog_logicval> last_written;
+    bool have_last = false;
+    uint64_t last_written_cycle = 0;
+
+    void write_header();
+    void write_value(const signal &s, const s_xsi_vlog_logicval* value);
+    void write_cycle(const uint64_t &cycle, const s_xsi_vlog_logicval* values);
+    void write_gap(const uint64_t &cycle);
+    void clear_history();
+
+public:
+    daphne_st_signal_tracer() = default;
+    ~daphne_st_signal_tracer();
+    daphne_st_signal_tracer(const daphne_st_signal_tracer&) = delete;
+    daphne_st_signal_tracer& operator=(const daphne_st_signal_tracer&) = delete;
+
+    // Truncates filename and forgets the previous signals. Throws std::runtime_error if it cannot be opened.
+    void open(const std::string &filename);
+    void close();
+    bool is_open() const { return this->output.is_open(); }
+    // Must be called before the first record(); the values of record() follow this order.
+    void add_signal(const std::string &name, const uint16_t &width);
+    size_t get_words_per_cycle() const { return this->words_per_cycle; }
+    size_t get_number_of_signals() const { return this->signals.size(); }
+
+    void set_window_all() { this->mode = trace_window_mode::all; }
+    void set_cycle_range(const uint64_t &first, const uint64_t &last);
+    void set_trigger_window(const uint64_t &pre, const uint64_t &post);
+    trace_window_mode get_window_mode() const { return this->mode; }
+
+    // cycle increases monotonically across runs and gives the VCD time; run_cycle restarts with
+    // every run and is the unit of both windows. Several records may share a run_cycle, e.g. the
+    // simulator passes the input sample index with one record per fclk cycle. trigger is only used
+    // in around_trigger mode.
+    void record(const uint64_t &cycle, const uint64_t &run_cycle, const s_xsi_vlog_logicval* values, const bool &trigger);
+};
+
+}
+
+#endif // DAPHNE_ST_SIGNAL_TRACER_H
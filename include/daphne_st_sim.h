@@ -9,13 +9,42 @@
 #include <fstream>
 #include <memory>
 #include <bitset>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "xsi_loader.h"
 #include "fddetdataformats/DAPHNEFrame.hpp"
 #include "nlohmann/json.hpp"
+#include "daphne_st_spsc_ring.h"
+#include "daphne_st_frame_decoder.h"
+#include "daphne_st_event_log.h"
+#include "daphne_st_profiler.h"
+#include "daphne_st_configuration.h"
+#include "daphne_st_counters.h"
+#include "daphne_st_waveform_store.h"
+#include "daphne_st_signal_tracer.h"
+#include "daphne_st_dpi_bridge.h"
+#include "daphne_st_clock_scheduler.h"
+#include "daphne_st_xsi_backend.h"
+#include "daphne_st_input_source.h"
+#include "daphne_st_trigger_scheduler.h"
 
 namespace daphne_st_simulator{
 
+// full: the original 320 aclk cycles with every clock toggling.
+// minimal: the depth derived from the design (get_reset_depth()), flushing the aclk pipelines with aclk alone.
+enum class reset_mode { full, minimal };
+
+// Self-trigger times of several STC inputs, one run_simulation() pass per input with the spy buffer
+// output (st_40_selftrigger_4_spybuffer) pointed at it.
+struct trigger_timeline{
+    std::vector<uint16_t> channels;                  // STC inputs, 8*afe + channel
+    std::vector<std::vector<uint64_t>> rising_edges; // input sample indices (counting on through the drain), one list per entry of channels
+    // One row per trigger: input, ch_id, sample_index.
+    void write_csv(std::ostream &os) const;
+};
+
 class daphne_st_top_hdl_simulator{
 private:
     // Atributes
@@ -33,27 +62,177 @@ private:
 
     std::vector<uint32_t> simulation_stream = {}; //consider preallocation
 
+    // Pipeline stages of run_simulation(): loader thread -> kernel (calling) thread -> writer thread.
+    struct input_block{
+        std::vector<uint16_t> samples; // sample-major, samples[i*number_of_enabled_channels + channel]
+        size_t n_samples = 0;
+    };
+    struct output_block{
+        std::vector<uint32_t> words;
+        std::vector<frame_marker> markers;
+        size_t n_words = 0;
+    };
+    size_t pipeline_block_samples = 4096;
+    size_t pipeline_depth = 8;
+    daphne_st_spsc_ring<output_block>* output_ring = nullptr;
+    output_block* output_slot = nullptr;
+    // set by the loader or writer thread when its stage throws; the kernel rethrows them after the join
+    std::exception_ptr loader_error;
+    std::exception_ptr writer_error;
+    std::atomic<bool> stage_failed{false};
+    daphne_st_frame_decoder frame_decoder;
+    daphne_st_event_log event_log;
+    uint64_t captured_words = 0; // kernel-side output_cycle, which belongs to the writer while running
+    daphne_st_profiler profiler; // only filled when built with DAPHNE_ST_SIM_PROFILING
+    std::string profile_report_file;
+
+    // Port numbers used on every cycle, cached so the kernel thread never does a map lookup.
+    int aclk_port = -1;
+    int fclk_port = -1;
+    int oeiclk_port = -1;
+    int dout_port = -1;
+    int kout_port = -1;
+    std::vector<int> enabled_input_ports;
+    s_xsi_vlog_logicval dout_value = {0x000000BC, 0x00000000};
+    s_xsi_vlog_logicval kout_value = {0x00000001, 0x00000000};
+    frame_marker dout_marker = frame_marker::none; // of the last word read by cycle_and_capture_output()
+
+    // Timing system model driving the timestamp port: start + ticks per aclk cycle (numerator/denominator).
+    // One DUNE timestamp tick is 16 ns, i.e. one 62.5 MHz aclk cycle, hence 1/1 by default.
+    int timestamp_port = -1;
+    uint64_t timestamp_start = 0;
+    uint64_t timestamp_counter = 0;
+    uint64_t timestamp_written = 0;  // last value put on the port, which starts at zero
+    uint64_t timestamp_numerator = 1;
+    uint64_t timestamp_denominator = 1;
+    uint64_t timestamp_fraction = 0;
+    s_xsi_vlog_logicval timestamp_value[2] = {{0x00000000, 0x00000000}, {0x00000000, 0x00000000}};
+
+    // Rcount_addr/Rcount readout of the STC counters, one address per oeiclk cycle (rcount_mux_proc registers on oeiclk).
+    int rcount_addr_port = -1;
+    int rcount_port = -1;
+    bool counter_readout_enabled = false;
+    uint64_t counter_readout_period = 0;  // samples between passes, 0 = end of run only
+    int32_t counter_readout_index = -1;   // counter_readout_address() index being read, -1 when no pass is running
+    uint64_t oeiclk_edges = 0;            // oeiclk rising edges of scheduled clocks; in 2:1 stepping every fclk edge is one
+    uint64_t rcount_addr_edge = 0;        // oeiclk_edges when Rcount_addr was last put
+    uint64_t counter_run_samples = 0;
+    counter_snapshot counter_pass;
+    std::vector<counter_snapshot> counter_series;
+    s_xsi_vlog_logicval rcount_addr_value = {0x00000000, 0x00000000};
+    s_xsi_vlog_logicval rcount_value[2] = {{0x00000000, 0x00000000}, {0x00000000, 0x00000000}};
+
+    // Optional capture of the afe_dat_*_filtered outputs, one value per captured channel per input sample.
+    std::string filtered_capture_file;
+    std::vector<uint16_t> filtered_capture_channels;
+    uint32_t filtered_capture_block_samples = 65536;
+    std::vector<int> filtered_ports;
+    s_xsi_vlog_logicval filtered_value = {0x00000000, 0x00000000};
+    daphne_st_waveform_store_writer filtered_store;
+
+    // Selective tracing of top-level ports, one point per fclk cycle of run_simulation().
+    daphne_st_signal_tracer signal_tracer;
+    std::vector<int> traced_ports;
+    std::vector<uint16_t> traced_words; // s_xsi_vlog_logicval words per traced port
+    std::vector<s_xsi_vlog_logicval> traced_values;
+    int trace_trigger_port = -1;
+    s_xsi_vlog_logicval trace_trigger_value = {0x00000000, 0x00000000};
+    bool trace_trigger_previous = false;
+    uint64_t trace_cycle = 0;
+
+    // Input sample the captures of run_simulation() belong to: the kernel loop's sample_index, then one
+    // more per aclk cycle of the drain. Trace windows and spy buffer edges are kept in these units.
+    uint64_t run_sample_index = 0;
+    bool run_input_done = true;
+
+    // Rising edges of st_40_selftrigger_4_spybuffer, sampled on every fclk cycle.
+    bool spybuffer_capture = false;
+    int spybuffer_port = -1;
+    s_xsi_vlog_logicval spybuffer_value = {0x00000000, 0x00000000};
+    bool spybuffer_previous = false;
+    std::vector<uint64_t> spybuffer_edges;
+
+    // st40_top_dpi_wrapper.sv only: dpi_mode hands the clocks and the stimulus to the HDL.
+    int dpi_mode_port = -1;
+    size_t dpi_run_samples = 4096; // input samples per run() call
+    daphne_st_dpi_bridge dpi_bridge;
+    uint64_t dpi_next_cycle = 0;       // fclk cycle of the next word of the stream
+    std::vector<uint32_t> dpi_stream;  // words of one collect_dpi_words() with the idles put back
+    std::vector<frame_marker> dpi_markers; // marker of each word of dpi_stream
+
     // Flags.
     bool sof_flag = false; // Start of frame flag
     bool eof_flag = false; // End of frame flag
+
+    // Writer side of the capture: every dout word seen, or only SOF..EOF in sparse mode.
+    bool sparse_capture = false;
+    uint64_t output_cycle = 0;           // dout words seen since the stream was cleared
+    size_t sparse_words_left = 0;        // words of the current frame still to store
+    std::vector<uint64_t> frame_cycles;  // output_cycle of every SOF
     bool clock_tilt_flag = false; // Clock tilt flag
 
+    // set_clock_frequencies(): free-running clocks stepped edge by edge instead of the 2:1 cycle_f_clock().
+    bool scheduled_clocks = false;
+    daphne_st_clock_scheduler clock_scheduler;
+    uint32_t aclk_clock = 0;
+    uint32_t fclk_clock = 0;
+    uint32_t oeiclk_clock = 0;
+    std::vector<clock_edge> clock_edges;
+
     uint64_t clk_sim_step = 40; // 4000 ps.
 
     // counters
     uint64_t packet_counter = 0;
+    uint64_t run_first_captured_word = 0; // captured_words when the run started
 
     uint16_t ncycles_stop_condition = 2500;
+    // End the drain when sendCount reaches the PCount sum; otherwise on ncycles_stop_condition idles.
+    bool drain_on_counters = true;
+
+    // set_configuration_timeline(): changes applied by the kernel stage at their sample index.
+    std::vector<configuration_change> configuration_timeline;
+    size_t next_configuration_change = 0;
+    uint64_t counted_channels = 0; // inputs enabled at some point of the run, their PCount holds frames of it
+
+    // set_external_triggers(): ti_trigger / ti_trigger_stbr strobes of the kernel stage.
+    std::unique_ptr<daphne_st_trigger_scheduler> trigger_scheduler;
+    std::vector<uint64_t> external_trigger_samples;
+    uint64_t next_trigger_sample = UINT64_MAX;
+    bool trigger_strobe = false;
+
+    // Reset depth of st40_top, in aclk cycles.
+    static constexpr uint32_t full_reset_cycles = 320;
+    static constexpr uint32_t delay_line_taps = 7 * 32;  // SRLC32E chain of stc.vhd ahead of the signal_delay tap
+    static constexpr uint32_t trigger_latency = 64;      // trig.vhd pipeline, as assumed by stc.vhd
+    static constexpr uint32_t fifo_reset_cycles = 5;     // FIFO36E1 needs RST high for 5 cycles of WRCLK and RDCLK
+    static constexpr uint32_t reset_sync_stages = 3;     // registered resets of the filters and counter synchronizers
+    reset_mode reset_type = reset_mode::minimal;
 
     std::vector<uint16_t> enabled_channels;
+    self_trigger_configuration configuration;
 
-    std::unique_ptr<Xsi::Loader> loader;
+    std::unique_ptr<daphne_st_xsi_backend> loader;
+    xsi_linking linking = xsi_linking::shared;
     s_xsi_setup_info info;
     
     // constant values
     const s_xsi_vlog_logicval one_val  = {0x00000001, 0x00000000};
     const s_xsi_vlog_logicval zero_val = {0x00000000, 0x00000000};
 
+    // Every XSI access of the simulation goes through these so it can be profiled.
+    void xsi_put_value(const int &port_number, const void* value){
+        DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::xsi_put_value);
+        this->loader->put_value(port_number, value);
+    }
+    void xsi_get_value(const int &port_number, void* value){
+        DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::xsi_get_value);
+        this->loader->get_value(port_number, value);
+    }
+    void xsi_run(const uint64_t &step){
+        DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::xsi_run);
+        this->loader->run(step);
+    }
+
     void append_logic_val_bit_to_string(std::string& retVal, int aVal, int bVal);
     void append_logic_val_to_string(std::string& retVal, int aVal, int bVal, int max_bits);
     std::string logic_val_to_string(s_xsi_vlog_logicval* value, int size);
@@ -65,24 +244,159 @@ private:
     void get_port_value(const std::string &port_name);
     void cycle_a_clock();
     void cycle_f_clock();
+    void cycle_a_clock_only();
+    uint32_t step_clock_edges();
+    void advance_timestamp();
+    void restart_timestamp();
     void run_n_cycles(const int & n_cycles, const std::string & which_clock);
     void reset_design();
-    void set_input_signal_ports(std::vector<uint16_t> &input_data);
-    void push_back_port_value(std::vector<uint32_t> &stream, const uint32_t &value);
-    std::vector<uint16_t> get_channels_input_data(const std::vector<uint16_t> &input_data, const int &iteration, const int &length_of_waveforms);
+    void update_enabled_input_ports();
+    void set_input_signal_ports(const uint16_t* channels_input_data);
+    void push_back_port_value(std::vector<uint32_t> &stream, const uint32_t &value, const frame_marker &marker);
+    uint32_t capture_output();
+    uint32_t cycle_and_capture_output();
+    void cycle_sample_and_capture_output();
+    void fill_configuration_port_values(const self_trigger_configuration &configuration);
+    void apply_configuration_change(const self_trigger_configuration &configuration);
+    void set_trigger_strobe(const bool &high);
+    void load_input_blocks(const daphne_st_input_source &source,
+                           daphne_st_spsc_ring<input_block> &input_ring, const std::atomic<bool> &stop);
+    void write_output_blocks(daphne_st_spsc_ring<output_block> &output_ring);
+    input_block* next_input_block(daphne_st_spsc_ring<input_block> &input_ring){
+        DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::input_wait);
+        return input_ring.wait_consumer_slot();
+    }
+    void put_rcount_addr(const uint32_t &address);
+    bool rcount_registered() const { return !this->scheduled_clocks || this->oeiclk_edges != this->rcount_addr_edge; }
+    void begin_run(const uint64_t &length_of_input_data);
+    void end_run(const uint64_t &length_of_input_data);
+    void read_frame_counters(uint64_t &built, uint64_t &sent);
+    void drain_until_sent();
+    void drain_until_idle();
+    void drain_output_stream();
+    void start_counter_readout(const uint64_t &sample_index);
+    void step_counter_readout();
+    void read_counters(const uint64_t &sample_index);
+    void capture_filtered_outputs();
+    void trace_signals();
+    void capture_spybuffer_trigger();
+    void collect_dpi_words(const uint64_t &until_cycle);
+    void read_dpi_frame_counters(uint64_t &built, uint64_t &sent);
+    void drain_dpi_output_stream();
     
 public:
     daphne_st_top_hdl_simulator(const std::string &design_libname, const std::string &simkernel_libname);
+    // Traces the whole design into debug_waveforms.wdb, which is slow; set_signal_trace() records a few ports.
     daphne_st_top_hdl_simulator(const std::string &design_libname, const std::string &simkernel_libname, const bool &enable_debug);
+    // xsi_linking::isolated loads the design and kernel in a dlmopen namespace of their own, so
+    // simulators can run on separate threads of one process; see daphne_st_xsi_backend.h for the limits.
+    daphne_st_top_hdl_simulator(const std::string &design_libname, const std::string &simkernel_libname, const xsi_linking &linking);
     ~daphne_st_top_hdl_simulator();
-    void set_configuration(const std::string &configFile); // Here use the same configuration as in the DAQ configuration file.
+    void set_configuration(const std::string &configFile, const size_t &device_index = 0); // Here use the same configuration as in the DAQ configuration file.
+    // Applies a configuration to the open design; run_simulation() resets the design before stepping.
+    void set_configuration(const self_trigger_configuration &configuration);
+    const self_trigger_configuration& get_configuration() const { return this->configuration; }
+    // Changes run_simulation() applies while stepping, each writing only the ports whose value differs:
+    // threshold steps, a filter_mode switch, a channel mask toggle... The timeline is kept and replayed by
+    // every run; each run starts from the set_configuration() configuration and returns to it at the end.
+    // Throws std::invalid_argument for a change of input_channels or an unknown filter_mode.
+    void set_configuration_timeline(std::vector<configuration_change> timeline);
+    void clear_configuration_timeline() { this->configuration_timeline.clear(); }
+    const std::vector<configuration_change>& get_configuration_timeline() const { return this->configuration_timeline; }
+    // External triggers for run_simulation(): adhoc and ti_trigger are set to the command and ti_trigger_stbr is
+    // raised for the aclk cycle of each scheduled sample, so trig.vhd fires on all 40 inputs at once whatever
+    // the self-trigger does; only enabled inputs build frames. The ports are written on strobe edges only.
+    // Throws std::invalid_argument for a non-positive rate.
+    void set_external_triggers(const trigger_scheduler_configuration &configuration);
+    void clear_external_triggers() { this->trigger_scheduler.reset(); }
+    // Samples strobed during the last run_simulation().
+    const std::vector<uint64_t>& get_external_trigger_samples() const { return this->external_trigger_samples; }
     void close();
     const std::vector<uint16_t>& get_enabled_channels() const { return this->enabled_channels;}
+    // Channel-major input, input_data[channel*length + i], one channel per enabled input.
     void run_simulation(const std::vector<uint16_t> &input_data);
+    // Same run, with the samples read block by block from source instead of a materialised vector.
+    void run_simulation(const daphne_st_input_source &source);
     const std::vector<uint32_t>& get_simulation_stream() const { return this->simulation_stream; }
+    // The stream keeps growing across runs until cleared.
+    void clear_simulation_stream() { this->simulation_stream.clear(); this->frame_cycles.clear(); this->output_cycle = 0; this->packet_counter = 0; }
+    // Keep only the words from each SOF to its EOF in the simulation stream instead of every dout word.
+    void set_sparse_capture(const bool &enable) { this->sparse_capture = enable; }
+    // fclk cycle (index in the full stream) of the SOF of every frame since the stream was cleared.
+    const std::vector<uint64_t>& get_frame_cycles() const { return this->frame_cycles; }
     void set_clk_sim_step(const uint64_t &clk_sim_step) { this->clk_sim_step = clk_sim_step; }
+    // Runs aclk, fclk and oeiclk (Hz, 0 = same as fclk) at their own frequencies from a queue of edges,
+    // e.g. fclk at the 120.237 MHz of the FELIX link; input samples still change once per aclk cycle.
+    // 62.5 / 125 / 125 MHz is the default 2:1 stepping. Call after set_clk_sim_step(). Drain limits
+    // count fclk cycles; trace windows and spy buffer triggers are input sample indices at any ratio.
+    void set_clock_frequencies(const uint64_t &aclk, const uint64_t &fclk, const uint64_t &oeiclk = 0);
+    void set_reset_mode(const reset_mode &mode) { this->reset_type = mode; }
+    // Timestamp of the first aclk cycle after reset in every run_simulation(); give parallel shards
+    // consecutive starts so their frames can be merged in time.
+    void set_timestamp_start(const uint64_t &timestamp_start) { this->timestamp_start = timestamp_start; }
+    uint64_t get_timestamp_start() const { return this->timestamp_start; }
+    // Timestamp ticks per aclk cycle as a ratio, for timing systems not at 62.5 MHz.
+    void set_timestamp_ticks_per_aclk(const uint64_t &numerator, const uint64_t &denominator = 1);
+    // Value the next aclk rising edge will see.
+    uint64_t get_timestamp() const { return this->timestamp_counter; }
+    // aclk cycles reset is held for by reset_design() with the current configuration and reset mode.
+    uint32_t get_reset_depth() const;
     uint64_t get_clk_sim_step() const { return this->clk_sim_step; }
+    // The stream holds no kout, so framing falls back to the byte pattern; the frames of get_decoded_frames() use kout.
     std::vector<dunedaq::fddetdataformats::DAPHNEFrame> decode_simulation_stream(const std::vector<uint32_t> &simulation_stream);
+    // Frames decoded by the writer stage during the last run_simulation().
+    const std::vector<dunedaq::fddetdataformats::DAPHNEFrame>& get_decoded_frames() const { return this->frame_decoder.get_frames(); }
+    uint64_t get_malformed_frames() const { return this->frame_decoder.get_malformed_frames(); }
+    // Samples per block handed between pipeline stages and number of blocks in flight.
+    void set_pipeline_geometry(const size_t &block_samples, const size_t &depth) { this->pipeline_block_samples = block_samples; this->pipeline_depth = depth; }
+    // Structured log of SOF/EOF words, idle timeouts, configurations and runs, drained to filename in the background.
+    void set_event_log(const std::string &filename, const event_log_format &format = event_log_format::json_lines,
+                       const event_level &min_level = event_level::info) { this->event_log.open(filename, format, min_level); }
+    daphne_st_event_log& get_event_log() { return this->event_log; }
+    // Phase timers and XSI call counters, accumulated over runs when built with DAPHNE_ST_SIM_PROFILING.
+    const daphne_st_profiler& get_profiler() const { return this->profiler; }
+    void reset_profiler() { this->profiler.reset(); }
+    // Reads the 40 TCount/PCount counters and sendCount through Rcount_addr while run_simulation() steps:
+    // a pass (81 oeiclk cycles) every period samples, 0 for none, and at the end of the input. TCount clears
+    // when enable drops, so the end_of_run snapshot, taken after the drain, keeps the TCount read before it.
+    void set_counter_readout(const bool &enable, const uint64_t &period = 0);
+    // Snapshots of the last run_simulation(), the end_of_run one last.
+    const std::vector<counter_snapshot>& get_counter_series() const { return this->counter_series; }
+    counter_metrics get_counter_metrics() const;
+    void write_counter_series(const std::string &filename) const;
+    // After the input, stop as soon as sendCount equals the PCount sum of the enabled inputs (default), or
+    // fall back to waiting for ncycles_stop_condition idle words after the last EOF.
+    void set_drain_on_counters(const bool &enable) { this->drain_on_counters = enable; }
+    // Stores the afe_dat_*_filtered outputs of the given STC inputs (8*afe + channel) after every input sample
+    // of run_simulation() in filename, rewritten by each run; an empty filename turns the capture off.
+    // Read it back with daphne_st_waveform_store_reader.
+    void set_filtered_capture(const std::string &filename, const std::vector<uint16_t> &channels, const uint32_t &block_samples = 65536);
+    // Traces the named ports of st40_top to a VCD file instead of the whole design (see the debug
+    // constructor). XSI only reaches top-level ports, so internal signals such as an STC state have
+    // to be brought out to a port of st40_top first. Throws std::invalid_argument for unknown names.
+    void set_signal_trace(const std::string &filename, const std::vector<std::string> &signals);
+    // Window of input samples [first, last) of every run.
+    void set_trace_sample_range(const uint64_t &first, const uint64_t &last) { this->signal_tracer.set_cycle_range(first, last); }
+    // pre samples before and post samples after every rising edge of st_40_selftrigger_4_spybuffer,
+    // the self-trigger of the channel selected by spybuffer_channel.
+    void set_trace_trigger_window(const uint64_t &pre, const uint64_t &post) { this->signal_tracer.set_trigger_window(pre, post); }
+    // run_simulation() for a design elaborated from st40_top_dpi_wrapper.sv (st40_dpi_sim in elaborate.csh):
+    // the wrapper generates aclk/fclk/oeiclk and the timestamp and pulls the samples through DPI-C, so the
+    // kernel is entered once per dpi run block instead of four times per sample. Its clocks are fixed, so
+    // clk_sim_step must be 4 ns in kernel time units (4000 with the 1 ps precision of elaborate.csh), and
+    // the timestamp advances one tick per aclk cycle; both throw std::invalid_argument otherwise. Counter readout, filtered capture, signal tracing
+    // and the spy buffer capture need the port-driven run_simulation().
+    void run_simulation_dpi(const std::vector<uint16_t> &input_data);
+    bool has_dpi_wrapper() const { return this->dpi_mode_port >= 0; }
+    void set_dpi_run_samples(const size_t &samples) { this->dpi_run_samples = samples; }
+    // Records the input sample index of every rising edge of the spy buffer trigger output during run_simulation().
+    void set_spybuffer_capture(const bool &enable) { this->spybuffer_capture = enable; }
+    const std::vector<uint64_t>& get_spybuffer_triggers() const { return this->spybuffer_edges; }
+    // One run_simulation() of input_data per entry of channels (every enabled input if empty), each with the
+    // current configuration but spybuffer_channel set to that input. The simulation stream keeps growing across the passes.
+    trigger_timeline run_trigger_timeline(const std::vector<uint16_t> &input_data, std::vector<uint16_t> channels = {});
+    // JSON report written after each run_simulation() of a profiling build.
+    void set_profile_report(const std::string &filename) { this->profile_report_file = filename; }
 };
 
 }
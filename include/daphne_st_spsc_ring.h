@@ -0,0 +1,105 @@
+#ifndef DAPHNE_ST_SPSC_RING_H
+#define DAPHNE_ST_SPSC_RING_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+
+namespace daphne_st_simulator{
+
+// Lock-free single producer / single consumer ring of preallocated slots.
+// The producer fills producer_slot() in place and publishes it with producer_commit();
+// the consumer reads consumer_slot() in place and hands it back with consumer_release().
+// Slots are reused, so blocks holding vectors never reallocate once warmed up.
+template <typename T>
+class daphne_st_spsc_ring{
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0}; // next slot to write, owned by the producer
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to read, owned by the consumer
+    alignas(64) std::atomic<bool> closed{false};
+
+    static size_t round_up_power_of_two(size_t n){
+        size_t p = 1;
+        while(p < n) p <<= 1;
+        return p;
+    }
+
+    static void backoff(unsigned int &spins){
+        if(++spins < 64){
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+public:
+    explicit daphne_st_spsc_ring(const size_t &capacity) : slots(round_up_power_of_two(capacity < 2 ? 2 : capacity)){
+        this->mask = this->slots.size() - 1;
+    }
+
+    size_t capacity() const { return this->slots.size(); }
+
+    // Every slot, e.g. to preallocate block buffers before the threads start.
+    std::vector<T>& get_slots() { return this->slots; }
+
+    // Producer side. Returns nullptr when the ring is full.
+    T* producer_slot(){
+        size_t h = this->head.load(std::memory_order_relaxed);
+        if(h - this->tail.load(std::memory_order_acquire) == this->slots.size()){
+            return nullptr;
+        }
+        return &this->slots[h & this->mask];
+    }
+
+    void producer_commit(){
+        this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Blocks (spin, then yield) until a slot is free.
+    T* wait_producer_slot(){
+        unsigned int spins = 0;
+        T* slot;
+        while((slot = this->producer_slot()) == nullptr){
+            backoff(spins);
+        }
+        return slot;
+    }
+
+    // No more slots will be committed.
+    void close(){
+        this->closed.store(true, std::memory_order_release);
+    }
+
+    // Consumer side. Returns nullptr when the ring is empty.
+    T* consumer_slot(){
+        size_t t = this->tail.load(std::memory_order_relaxed);
+        if(t == this->head.load(std::memory_order_acquire)){
+            return nullptr;
+        }
+        return &this->slots[t & this->mask];
+    }
+
+    void consumer_release(){
+        this->tail.store(this->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Blocks until a slot is available; returns nullptr once the ring is closed and drained.
+    T* wait_consumer_slot(){
+        unsigned int spins = 0;
+        T* slot;
+        while((slot = this->consumer_slot()) == nullptr){
+            if(this->closed.load(std::memory_order_acquire)){
+                // a commit may have landed between the empty check and the closed check
+                return this->consumer_slot();
+            }
+            backoff(spins);
+        }
+        return slot;
+    }
+};
+
+}
+
+#endif // DAPHNE_ST_SPSC_RING_H
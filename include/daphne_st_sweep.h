@@ -0,0 +1,64 @@
+#ifndef DAPHNE_ST_SWEEP_H
+#define DAPHNE_ST_SWEEP_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <ostream>
+#include <cstdint>
+
+#include "daphne_st_configuration.h"
+#include "daphne_st_worker_pool.h"
+
+namespace daphne_st_simulator{
+
+// Values to scan per self-trigger parameter. An empty axis keeps the value of the base configuration.
+struct sweep_grid{
+    std::vector<uint32_t> slope_threshold;
+    std::vector<uint32_t> pedestal_length;
+    std::vector<uint64_t> correlation_threshold;
+    std::vector<uint64_t> discrimination_threshold;
+    std::vector<std::string> filter_mode;
+
+    // Cartesian product of the axes, filter_mode varying slowest and slope_threshold fastest.
+    std::vector<self_trigger_configuration> expand(const self_trigger_configuration &base) const;
+};
+
+// Trigger statistics of one point of the sweep.
+struct sweep_point_result{
+    self_trigger_configuration configuration;
+    bool ok = false;                           // false if the worker failed before reporting the point
+    uint64_t frames = 0;
+    uint64_t malformed_frames = 0;
+    uint64_t output_words = 0;
+    double seconds = 0.0;
+    std::array<uint64_t, 64> frames_per_channel{}; // indexed by the DAPHNEFrame channel id (10*afe + channel)
+};
+
+// Runs the same stimulus through every point of a grid. Each worker process of a
+// daphne_st_worker_pool opens the elaborated design once and then, for every point it pulls, applies the
+// configuration (set_port_initial_values()) and runs the stimulus (reset_design() first), so
+// loader->open() and the port lookup are paid once per worker rather than once per point.
+class daphne_st_sweep{
+private:
+    std::string design_libname;
+    std::string simkernel_libname;
+    uint64_t clk_sim_step = 4000;
+    unsigned int n_workers = 0; // 0 = std::thread::hardware_concurrency()
+
+    void run_worker(const std::vector<self_trigger_configuration> &points, const std::vector<uint16_t> &input_data,
+                    const daphne_st_worker_pool::next_task_function &next_task, const daphne_st_worker_pool::send_function &send);
+
+public:
+    daphne_st_sweep(const std::string &design_libname, const std::string &simkernel_libname);
+    void set_number_of_workers(const unsigned int &n_workers) { this->n_workers = n_workers; }
+    void set_clk_sim_step(const uint64_t &clk_sim_step) { this->clk_sim_step = clk_sim_step; }
+    // input_data is channel-major over base.input_channels, as for run_simulation().
+    std::vector<sweep_point_result> run(const self_trigger_configuration &base, const sweep_grid &grid,
+                                        const std::vector<uint16_t> &input_data);
+    static void write_csv(std::ostream &os, const std::vector<sweep_point_result> &results);
+};
+
+}
+
+#endif // DAPHNE_ST_SWEEP_H
@@ -0,0 +1,46 @@
+#ifndef DAPHNE_ST_TRIGGER_SCHEDULER_H
+#define DAPHNE_ST_TRIGGER_SCHEDULER_H
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+namespace daphne_st_simulator{
+
+enum class trigger_pattern { fixed_rate, poisson, list };
+
+struct trigger_scheduler_configuration{
+    trigger_pattern pattern = trigger_pattern::fixed_rate;
+    double rate = 1.0e3;               // Hz, fixed_rate and poisson
+    double sample_rate = 62.5e6;       // Hz, aclk
+    uint64_t first_sample = 0;         // fixed_rate: sample of the first trigger; poisson: no trigger before it
+    std::vector<uint64_t> timestamps;  // list: timestamp of each trigger, as on the timestamp port
+    uint8_t command = 0;               // driven on both ti_trigger and adhoc, trig.vhd fires when they match
+    uint64_t seed = 1;                 // poisson
+};
+
+// Sample indices (aclk cycles from the start of run_simulation()) of external triggers: a fixed
+// rate, Poisson arrivals or a list of timestamps. Triggers that fall on the same sample fire once.
+class daphne_st_trigger_scheduler{
+private:
+    trigger_scheduler_configuration configuration;
+    std::mt19937_64 random_engine;
+    std::vector<uint64_t> list_samples;
+    uint64_t fired = 0;          // triggers returned since start()
+    uint64_t last_sample = 0;
+    double poisson_time = 0.0;   // samples
+
+public:
+    // Throws std::invalid_argument for a non-positive rate or sample rate.
+    explicit daphne_st_trigger_scheduler(const trigger_scheduler_configuration &configuration);
+    // Rewinds to the start of a run whose sample i carries timestamp_start + floor(i * numerator / denominator).
+    void start(const uint64_t &timestamp_start, const uint64_t &numerator = 1, const uint64_t &denominator = 1);
+    // Sample of the next trigger, UINT64_MAX when the pattern has no more.
+    uint64_t next();
+    uint8_t get_command() const { return this->configuration.command; }
+    const trigger_scheduler_configuration& get_configuration() const { return this->configuration; }
+};
+
+}
+
+#endif // DAPHNE_ST_TRIGGER_SCHEDULER_H
@@ -0,0 +1,79 @@
+#ifndef DAPHNE_ST_WAVEFORM_GENERATOR_H
+#define DAPHNE_ST_WAVEFORM_GENERATOR_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace daphne_st_simulator{
+
+enum class sipm_type { fbk, hpk };
+
+struct waveform_generator_configuration{
+    sipm_type sensor = sipm_type::fbk;
+    double overvoltage = 4.5;              // V, common_conf.ov.fbk / common_conf.ov.hpk
+    double gain_per_volt = 8.0;            // ADC counts per photoelectron per volt of overvoltage
+    double gain_spread = 0.1;              // relative RMS of the single photoelectron amplitude
+    double baseline = 8190.0;              // ADC counts
+    double photon_rate = 1.0e4;            // Hz, Poisson rate of light pulses per channel
+    double mean_photoelectrons = 1.0;      // Poisson mean of photoelectrons per pulse (at least 1 is generated)
+    std::vector<double> amplitude_spectrum; // optional weights for 1, 2, 3... photoelectrons, overrides the Poisson mean
+    double white_noise_rms = 2.0;          // ADC counts
+    double pink_noise_rms = 1.0;           // ADC counts, 1/f noise
+    double drift_amplitude = 0.0;          // ADC counts, sinusoidal baseline drift
+    double drift_period = 6.25e7;          // samples
+    double sample_rate = 62.5e6;           // Hz
+    uint64_t seed = 1;
+};
+
+// Truth information of one generated pulse.
+struct generated_pulse{
+    uint64_t sample_index;
+    uint16_t photoelectrons;
+};
+
+// Synthetic SiPM stimulus: Poisson arrivals of single photoelectron templates with an
+// amplitude spectrum (pile-up comes out naturally), white and 1/f noise and baseline drift.
+// Successive generate() calls continue the same stream, so arbitrarily long runs can be
+// produced block by block into preallocated buffers. Channels are independent and are
+// generated in parallel; the random numbers come from a lane-interleaved xoroshiro128+
+// so the uniform draws vectorize.
+class daphne_st_waveform_generator{
+private:
+    struct channel_state;
+
+    waveform_generator_configuration configuration;
+    std::vector<float> spe_template;
+    std::vector<channel_state> channels;
+    std::vector<double> spectrum_cdf;
+    double pink_noise_scale = 0.0;
+    unsigned int n_threads = 0; // 0 = std::thread::hardware_concurrency()
+    bool record_truth = false;
+
+    void generate_channel(channel_state &state, uint16_t* output, const size_t &n_samples);
+    uint16_t draw_photoelectrons(channel_state &state);
+
+public:
+    daphne_st_waveform_generator(const waveform_generator_configuration &configuration, const size_t &n_channels);
+    ~daphne_st_waveform_generator();
+    // Reads the overvoltage of the selected sensor from the common_conf.ov section of a DAQ configuration file.
+    static waveform_generator_configuration configuration_from_file(const std::string &configFile, const sipm_type &sensor);
+    // Built-in single photoelectron shape, normalised to a peak of 1.
+    static std::vector<float> default_spe_template(const sipm_type &sensor);
+    // Replaces the built-in template, e.g. with a measured one. It is normalised to a peak of 1.
+    void set_spe_template(const std::vector<float> &spe_template);
+    void set_number_of_threads(const unsigned int &n_threads) { this->n_threads = n_threads; }
+    void set_record_truth(const bool &record_truth) { this->record_truth = record_truth; }
+    // Writes the next n_samples of every channel to buffer[channel*channel_stride + i].
+    void generate(uint16_t* buffer, const size_t &n_samples, const size_t &channel_stride);
+    // Resizes channel_major and fills it in the layout expected by run_simulation().
+    void generate(std::vector<uint16_t> &channel_major, const size_t &n_samples);
+    size_t get_number_of_channels() const;
+    uint64_t get_generated_samples() const;
+    const std::vector<generated_pulse>& get_truth(const size_t &channel) const;
+    void clear_truth();
+};
+
+}
+
+#endif // DAPHNE_ST_WAVEFORM_GENERATOR_H
@@ -0,0 +1,104 @@
+#ifndef DAPHNE_ST_WAVEFORM_STORE_H
+#define DAPHNE_ST_WAVEFORM_STORE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <fstream>
+#include <cstdint>
+
+#include "daphne_st_spsc_ring.h"
+#include "daphne_st_mapped_file.h"
+
+namespace daphne_st_simulator{
+
+// On-disk layout, little endian:
+//   header: magic "DSTW", version, block_samples, n_channels (uint32 each), total_samples (uint64),
+//           channels[n_channels] (uint16, STC input 8*afe + channel), zero padding to 8 bytes.
+//   chunks: first_sample (uint64), n_samples (uint32), reserved (uint32), then one column of
+//           block_samples int16 per channel: the first sample, then sample-to-sample deltas.
+// Every chunk has the same size (the last one is padded), so sample s of any channel is found
+// without an index: chunk s / block_samples, column of the channel, then a prefix sum.
+struct waveform_store_header{
+    static constexpr uint32_t magic = 0x57545344; // "DSTW"
+    static constexpr uint32_t version = 1;
+    uint32_t block_samples = 0;
+    uint32_t n_channels = 0;
+    uint64_t total_samples = 0;
+    std::vector<uint16_t> channels;
+
+    size_t size() const { return (24 + 2 * this->channels.size() + 7) & ~size_t(7); }
+    size_t chunk_size() const { return 16 + 2 * size_t(this->n_channels) * this->block_samples; }
+};
+
+// Collects one value per channel per sample on the simulation thread and hands full blocks
+// to a background thread that delta-encodes and writes them.
+class daphne_st_waveform_store_writer{
+private:
+    struct block{
+        std::vector<uint16_t> columns; // columns[channel * block_samples + sample]
+        uint64_t first_sample = 0;
+        uint32_t n_samples = 0;
+    };
+
+    waveform_store_header header;
+    std::ofstream output;
+    std::unique_ptr<daphne_st_spsc_ring<block>> ring;
+    block* current = nullptr;
+    std::thread writer_thread;
+    std::vector<int16_t> encoded;
+    uint64_t next_sample = 0;
+    bool write_failed = false;
+
+    void write_blocks();
+
+public:
+    daphne_st_waveform_store_writer() = default;
+    ~daphne_st_waveform_store_writer();
+    daphne_st_waveform_store_writer(const daphne_st_waveform_store_writer&) = delete;
+    daphne_st_waveform_store_writer& operator=(const daphne_st_waveform_store_writer&) = delete;
+
+    // Truncates filename and starts the writer thread. Throws std::runtime_error if it cannot be opened.
+    void open(const std::string &filename, const std::vector<uint16_t> &channels,
+              const uint32_t &block_samples = 65536, const size_t &depth = 8);
+    // Flushes the last block, writes total_samples and stops the writer thread.
+    void close();
+    bool is_open() const { return this->current != nullptr; }
+
+    // value of the index-th channel passed to open() for the current sample
+    void put(const size_t &index, const uint16_t &value){
+        this->current->columns[index * this->header.block_samples + this->current->n_samples] = value;
+    }
+    void commit_sample(){
+        this->next_sample++;
+        if(++this->current->n_samples == this->header.block_samples){
+            this->ring->producer_commit();
+            this->current = this->ring->wait_producer_slot();
+            this->current->first_sample = this->next_sample;
+            this->current->n_samples = 0;
+        }
+    }
+};
+
+// Random access to a store by channel and sample range, through a read-only mapping.
+class daphne_st_waveform_store_reader{
+private:
+    daphne_st_mapped_file file;
+    waveform_store_header header;
+
+public:
+    explicit daphne_st_waveform_store_reader(const std::string &filename);
+    const std::vector<uint16_t>& get_channels() const { return this->header.channels; }
+    uint64_t get_total_samples() const { return this->header.total_samples; }
+    uint32_t get_block_samples() const { return this->header.block_samples; }
+    // Samples [first, first + count) of channel (an STC input present in the store), clipped to the
+    // end of the capture. Throws std::invalid_argument for channels that were not captured.
+    void read(const uint16_t &channel, const uint64_t &first, const uint64_t &count, std::vector<uint16_t> &samples) const;
+    // Every stored channel, channel-major in get_channels() order.
+    void read(const uint64_t &first, const uint64_t &count, std::vector<uint16_t> &channel_major) const;
+};
+
+}
+
+#endif // DAPHNE_ST_WAVEFORM_STORE_H
@@ -0,0 +1,31 @@
+#ifndef DAPHNE_ST_WORKER_POOL_H
+#define DAPHNE_ST_WORKER_POOL_H
+
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace daphne_st_simulator{
+
+// Pool of forked worker processes. XSI holds one design per loaded kernel library, so
+// parallel simulations need separate processes rather than threads.
+//
+// Every worker runs worker(next_task, send): next_task(index) hands out the next task index
+// from a counter shared by all workers and returns false once all n_tasks are taken; send()
+// writes one record of record_size bytes back to the parent. Records are at most PIPE_BUF
+// bytes so the workers share one pipe without interleaving. The parent calls on_record for
+// every record as it arrives and returns once every worker has exited. Workers' stdout is
+// sent to /dev/null, stderr is kept.
+class daphne_st_worker_pool{
+public:
+    using next_task_function = std::function<bool(uint64_t&)>;
+    using send_function = std::function<void(const void*)>;
+
+    static void run(const unsigned int &n_workers, const size_t &n_tasks, const size_t &record_size,
+                    const std::function<void(const next_task_function&, const send_function&)> &worker,
+                    const std::function<void(const void*)> &on_record);
+};
+
+}
+
+#endif // DAPHNE_ST_WORKER_POOL_H
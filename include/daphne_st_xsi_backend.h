@@ -0,0 +1,112 @@
+#ifndef DAPHNE_ST_XSI_BACKEND_H
+#define DAPHNE_ST_XSI_BACKEND_H
+
+#include <string>
+
+#include "xsi.h"
+#include "xsi_loader.h"
+
+namespace daphne_st_simulator{
+
+// How the design library (xsimk.so) and librdi_simulator_kernel.so are linked into the process.
+// shared: Xsi::Loader, dlopen(RTLD_GLOBAL); one simulator per process.
+// isolated: dlmopen(LM_ID_NEWLM), each simulator gets its own copy of the kernel and its dependencies.
+enum class xsi_linking { shared, isolated };
+
+// The XSI calls the simulator makes, so it can drive either loader.
+class daphne_st_xsi_backend{
+public:
+    virtual ~daphne_st_xsi_backend() = default;
+    virtual void open(p_xsi_setup_info setup_info) = 0;
+    // Safe to call more than once.
+    virtual void close() = 0;
+    virtual void run(const XSI_INT64 &step) = 0;
+    virtual void get_value(const int &port_number, void* value) = 0;
+    virtual void put_value(const int &port_number, const void* value) = 0;
+    virtual int get_port_number(const char* port_name) = 0;
+    virtual void trace_all() = 0;
+    virtual const char* get_error_info() = 0;
+};
+
+class daphne_st_xsi_shared_backend : public daphne_st_xsi_backend{
+private:
+    Xsi::Loader loader;
+
+public:
+    daphne_st_xsi_shared_backend(const std::string &design_libname, const std::string &simkernel_libname)
+        : loader(design_libname, simkernel_libname) {}
+    void open(p_xsi_setup_info setup_info) override { this->loader.open(setup_info); }
+    void close() override { this->loader.close(); }
+    void run(const XSI_INT64 &step) override { this->loader.run(step); }
+    void get_value(const int &port_number, void* value) override { this->loader.get_value(port_number, value); }
+    void put_value(const int &port_number, const void* value) override { this->loader.put_value(port_number, value); }
+    int get_port_number(const char* port_name) override { return this->loader.get_port_number(port_name); }
+    void trace_all() override { this->loader.trace_all(); }
+    const char* get_error_info() override { return this->loader.get_error_info(); }
+};
+
+// Opens the kernel and then the design in a new link-map namespace, so every instance has its
+// own kernel globals and several simulators can step on different threads of one process, sharing
+// input buffers without copies. The kernel goes first so that, as the first object of the namespace,
+// its symbols are global there and the design resolves its xsi_* imports against this copy.
+//
+// Limits, checked by tests/test_xsi_isolation.cpp, which prints the instance count and memory per
+// instance of the real kernel; measured with glibc 2.36 and a stand-in library linking libstdc++:
+//  - glibc has 16 namespaces per process (DL_NNS), the base one included, so at most 15 instances;
+//    fewer when another library already uses dlmopen. Opening one more throws std::runtime_error.
+//  - Each namespace loads its own libc, and libraries with initial-exec TLS take static TLS each time.
+//    With the default reserve the 12th namespace already failed with "cannot allocate memory in static
+//    TLS block" (11 instances); GLIBC_TUNABLES=glibc.rtld.optional_static_tls=16384 gave all 15.
+//  - libc and libstdc++ alone cost 2.4 MB of resident memory per namespace; each instance adds its
+//    own librdi_simulator_kernel.so and the rest of the kernel's dependencies on top.
+//  - Process state is still shared: working directory, environment, file descriptors, signal handlers.
+//    Instances of the same snapshot write the same xsim.dir files, so give them log/wdb names of
+//    their own and do not enable tracing on more than one.
+//  - The DPI-C bridge is the copy loaded in the base namespace. A design loaded here would bind
+//    the sv_lib again in its own namespace, so run_simulation_dpi() is not available.
+class daphne_st_xsi_isolated_backend : public daphne_st_xsi_backend{
+private:
+    typedef xsiHandle (*open_function)(p_xsi_setup_info);
+    typedef void (*close_function)(xsiHandle);
+    typedef void (*run_function)(xsiHandle, XSI_INT64);
+    typedef void (*value_function)(xsiHandle, XSI_INT32, void*);
+    typedef XSI_INT32 (*port_number_function)(xsiHandle, const char*);
+    typedef void (*trace_all_function)(xsiHandle);
+    typedef const char* (*error_info_function)(xsiHandle);
+
+    void* kernel_library = nullptr;
+    void* design_library = nullptr;
+    xsiHandle design_handle = nullptr;
+
+    open_function xsi_open = nullptr;
+    close_function xsi_close = nullptr;
+    run_function xsi_run = nullptr;
+    value_function xsi_get_value = nullptr;
+    value_function xsi_put_value = nullptr;
+    port_number_function xsi_get_port_number = nullptr;
+    trace_all_function xsi_trace_all = nullptr;
+    error_info_function xsi_get_error_info = nullptr;
+
+    void* symbol(void* library, const char* name, const std::string &libname);
+    void unload();
+
+public:
+    // Throws std::runtime_error if either library cannot be loaded or lacks an XSI entry point.
+    daphne_st_xsi_isolated_backend(const std::string &design_libname, const std::string &simkernel_libname);
+    ~daphne_st_xsi_isolated_backend() override;
+    daphne_st_xsi_isolated_backend(const daphne_st_xsi_isolated_backend&) = delete;
+    daphne_st_xsi_isolated_backend& operator=(const daphne_st_xsi_isolated_backend&) = delete;
+
+    void open(p_xsi_setup_info setup_info) override;
+    void close() override;
+    void run(const XSI_INT64 &step) override { this->xsi_run(this->design_handle, step); }
+    void get_value(const int &port_number, void* value) override { this->xsi_get_value(this->design_handle, port_number, value); }
+    void put_value(const int &port_number, const void* value) override { this->xsi_put_value(this->design_handle, port_number, const_cast<void*>(value)); }
+    int get_port_number(const char* port_name) override { return this->xsi_get_port_number(this->design_handle, port_name); }
+    void trace_all() override { this->xsi_trace_all(this->design_handle); }
+    const char* get_error_info() override { return this->xsi_get_error_info(this->design_handle); }
+};
+
+}
+
+#endif // DAPHNE_ST_XSI_BACKEND_H
@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <thread>
+#include <new>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "daphne_st_sim.h"
+#include "daphne_st_csv_loader.h"
+#include "daphne_st_frame_decoder.h"
+#include "daphne_st_waveform_generator.h"
+#include "nlohmann/json.hpp"
+
+// Fixed throughput scenarios of the simulator and of the native stimulus/decoding code.
+// Every scenario uses fixed seeds and sizes so reports can be compared across commits:
+//   bench_daphne_st_sim [--design xsim.dir/st40_sim/xsimk.so] [--config ./config/conf.json]
+//                       [--xsi-samples N] [--native-samples N] [--only substring] [--output bench_daphne_st_sim.json]
+// XSI scenarios are skipped when the design library is missing. The JSON report goes to the
+// output file because the simulator itself writes to stdout.
+
+// Allocation counter, every operator new of the process goes through here.
+static std::atomic<uint64_t> allocation_count{0};
+
+void* operator new(std::size_t size){
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = malloc(size == 0 ? 1 : size)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, std::size_t) noexcept { free(p); }
+
+namespace {
+
+struct scenario_result{
+    uint64_t samples = 0; // samples per channel times channels
+    uint64_t frames = 0;
+    nlohmann::json details = nullptr; // scenario specific, copied to the report as is
+};
+
+struct stimulus_type{
+    std::string name;
+    double photon_rate; // Hz per channel, 0 = pedestal only
+};
+
+const std::vector<stimulus_type> stimuli = {{"pedestal", 0.0}, {"low_rate", 1.0e3}, {"high_rate", 1.0e5}};
+const std::vector<size_t> channel_counts = {1, 8, 40};
+const std::vector<std::string> filter_modes = {"compensated", "inverted", "xcorr", "raw"};
+
+// Every scenario runs in this process, so the high-water mark is reset before each one:
+// writing 5 to clear_refs restarts VmHWM from the current RSS (Linux 4.0+). Where that is not
+// possible the process-lifetime ru_maxrss is reported instead.
+bool reset_peak_rss(){
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.flush();
+    return clear_refs.good();
+}
+
+// current resident set from statm, for differences within a scenario
+uint64_t rss_kb(){
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+uint64_t peak_rss_kb(){
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)){
+        if(line.compare(0, 6, "VmHWM:") == 0){
+            return std::stoull(line.substr(6));
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+daphne_st_simulator::waveform_generator_configuration stimulus_configuration(const stimulus_type &stimulus){
+    daphne_st_simulator::waveform_generator_configuration conf;
+    conf.photon_rate = stimulus.photon_rate;
+    conf.mean_photoelectrons = 3.0;
+    conf.seed = 12345;
+    return conf;
+}
+
+// Writes a copy of the DAQ configuration with the first n_channels enabled and the given filter mode.
+std::string write_configuration(const std::string &base_config, const size_t &n_channels, const std::string &filter_mode){
+    std::ifstream input(base_config);
+    if(!input.is_open()){
+        throw std::runtime_error("Could not open configuration file: " + base_config);
+    }
+    nlohmann::json config = nlohmann::json::parse(input);
+    std::vector<int> channels;
+    for(size_t i = 0; i < n_channels; i++){
+        channels.push_back(int(i));
+    }
+    config["devices"][0]["self_trigger"]["enable_compensator"] = channels;
+    config["devices"][0]["self_trigger"]["filter_mode"] = filter_mode;
+    config["devices"][0]["channels"]["indices"] = channels;
+    std::string filename = "/tmp/bench_daphne_st_sim_" + std::to_string(getpid()) + ".json";
+    std::ofstream output(filename);
+    output << config.dump(2);
+    return filename;
+}
+
+class bench_runner{
+private:
+    std::string only;
+    nlohmann::json results = nlohmann::json::array();
+
+public:
+    explicit bench_runner(const std::string &only) : only(only) {}
+
+    void run(const std::string &name, const std::function<scenario_result()> &scenario){
+        if(!this->only.empty() && name.find(this->only) == std::string::npos){
+            return;
+        }
+        std::cerr << "Running " << name << "..." << std::endl;
+        const bool peak_reset = reset_peak_rss();
+        uint64_t allocations = allocation_count.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        scenario_result result = scenario();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocations = allocation_count.load(std::memory_order_relaxed) - allocations;
+        nlohmann::json entry;
+        entry["name"] = name;
+        entry["status"] = "ok";
+        entry["seconds"] = seconds;
+        entry["samples"] = result.samples;
+        entry["frames"] = result.frames;
+        entry["samples_per_second"] = seconds > 0.0 ? result.samples / seconds : 0.0;
+        entry["frames_per_second"] = seconds > 0.0 ? result.frames / seconds : 0.0;
+        entry["peak_rss_kb"] = peak_rss_kb();
+        entry["peak_rss_scope"] = peak_reset ? "scenario" : "process";
+        entry["allocations"] = allocations;
+        entry["allocations_per_sample"] = result.samples > 0 ? double(allocations) / result.samples : 0.0;
+        if(!result.details.is_null()){
+            entry["details"] = result.details;
+        }
+        this->results.push_back(entry);
+    }
+
+    void skip(const std::string &name, const std::string &reason){
+        if(!this->only.empty() && name.find(this->only) == std::string::npos){
+            return;
+        }
+        this->results.push_back({{"name", name}, {"status", "skipped"}, {"reason", reason}});
+    }
+
+    const nlohmann::json& get_results() const { return this->results; }
+};
+
+// Frames as they come out of the builders: SOF, payload, EOF, then some idle words.
+std::vector<uint32_t> synthetic_stream(const size_t &n_frames){
+    std::vector<uint32_t> stream;
+    stream.reserve(n_frames * (daphne_st_simulator::daphne_st_frame_decoder::payload_words + 12));
+    uint32_t state = 1;
+    for(size_t f = 0; f < n_frames; f++){
+        stream.push_back(0x0000003C);
+        for(size_t i = 0; i < daphne_st_simulator::daphne_st_frame_decoder::payload_words; i++){
+            state = state * 1664525u + 1013904223u;
+            stream.push_back(state & 0xFFFFFF00);
+        }
+        stream.push_back(0x000000DC);
+        for(int i = 0; i < 10; i++){
+            stream.push_back(0x000000BC);
+        }
+    }
+    return stream;
+}
+
+std::string write_csv(const size_t &rows, const size_t &columns){
+    std::string filename = "/tmp/bench_daphne_st_sim_" + std::to_string(getpid()) + ".csv";
+    std::ofstream output(filename);
+    for(size_t c = 0; c < columns; c++){
+        output << (c ? "," : "") << "ch" << c;
+    }
+    output << "\n";
+    uint32_t state = 7;
+    for(size_t r = 0; r < rows; r++){
+        for(size_t c = 0; c < columns; c++){
+            state = state * 1664525u + 1013904223u;
+            output << (c ? "," : "") << (8100 + (state >> 25));
+        }
+        output << "\n";
+    }
+    return filename;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    std::string design = "xsim.dir/st40_sim/xsimk.so";
+    std::string kernel = "librdi_simulator_kernel.so";
+    std::string base_config = "./config/conf.json";
+    std::string output_file = "bench_daphne_st_sim.json";
+    std::string only;
+    size_t xsi_samples = 100000;
+    size_t native_samples = 4000000;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if(i + 1 >= argc){
+                std::cerr << "ERROR: missing value for " << arg << std::endl;
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if(arg == "--design") design = value();
+        else if(arg == "--config") base_config = value();
+        else if(arg == "--xsi-samples") xsi_samples = std::stoull(value());
+        else if(arg == "--native-samples") native_samples = std::stoull(value());
+        else if(arg == "--only") only = value();
+        else if(arg == "--output") output_file = value();
+        else{
+            std::cerr << "ERROR: unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    bench_runner bench(only);
+
+    // Native scenarios: stimulus generation, CSV loading and stream decoding.
+    for(const auto &stimulus : stimuli){
+        for(const auto &n_channels : channel_counts){
+            bench.run("generator/" + stimulus.name + "/" + std::to_string(n_channels) + "ch", [&]() {
+                daphne_st_simulator::daphne_st_waveform_generator generator(stimulus_configuration(stimulus), n_channels);
+                std::vector<uint16_t> buffer(n_channels * 65536);
+                for(size_t done = 0; done < native_samples; done += 65536){
+                    generator.generate(buffer.data(), 65536, 65536);
+                }
+                return scenario_result{generator.get_generated_samples() * n_channels, 0};
+            });
+        }
+    }
+    bench.run("decoder/frames", [&]() {
+        const size_t n_frames = native_samples / 512;
+        std::vector<uint32_t> stream = synthetic_stream(n_frames);
+        auto frames = daphne_st_simulator::daphne_st_frame_decoder::decode(stream);
+        return scenario_result{stream.size(), frames.size()};
+    });
+    bench.run("csv_loader/8ch", [&]() {
+        const size_t rows = native_samples / 8;
+        std::string filename = write_csv(rows, 8);
+        std::vector<uint16_t> data;
+        daphne_st_simulator::daphne_st_csv_loader loader(filename, true);
+        daphne_st_simulator::csv_load_report report = loader.load(data, 8);
+        unlink(filename.c_str());
+        return scenario_result{report.rows * report.columns, 0};
+    });
+
+    // XSI scenarios: stimulus rates, channel counts and filter_output_selector modes.
+    std::vector<std::tuple<std::string, stimulus_type, size_t, std::string>> xsi_scenarios;
+    for(const auto &stimulus : stimuli){
+        xsi_scenarios.emplace_back("xsi/" + stimulus.name + "/8ch/inverted", stimulus, 8, "inverted");
+    }
+    for(const auto &n_channels : channel_counts){
+        if(n_channels != 8){
+            xsi_scenarios.emplace_back("xsi/low_rate/" + std::to_string(n_channels) + "ch/inverted", stimuli[1], n_channels, "inverted");
+        }
+    }
+    for(const auto &filter_mode : filter_modes){
+        if(filter_mode != "inverted"){
+            xsi_scenarios.emplace_back("xsi/high_rate/8ch/" + filter_mode, stimuli[2], 8, filter_mode);
+        }
+    }
+    if(access(design.c_str(), R_OK) != 0){
+        for(const auto &it : xsi_scenarios){
+            bench.skip(std::get<0>(it), design + " not found");
+        }
+    }else{
+        std::unique_ptr<daphne_st_simulator::daphne_st_top_hdl_simulator> simulator;
+        for(const auto &it : xsi_scenarios){
+            const stimulus_type &stimulus = std::get<1>(it);
+            const size_t n_channels = std::get<2>(it);
+            const std::string &filter_mode = std::get<3>(it);
+            if(!only.empty() && std::get<0>(it).find(only) == std::string::npos){
+                continue;
+            }
+            if(!simulator){
+                simulator = std::make_unique<daphne_st_simulator::daphne_st_top_hdl_simulator>(design, kernel);
+                simulator->set_clk_sim_step(4000);
+            }
+            std::string config_file = write_configuration(base_config, n_channels, filter_mode);
+            simulator->set_configuration(config_file);
+            unlink(config_file.c_str());
+            std::vector<uint16_t> input_data;
+            daphne_st_simulator::daphne_st_waveform_generator generator(stimulus_configuration(stimulus), n_channels);
+            generator.generate(input_data, xsi_samples);
+            bench.run(std::get<0>(it), [&]() {
+                simulator->run_simulation(input_data);
+                return scenario_result{xsi_samples * n_channels, simulator->get_decoded_frames().size()};
+            });
+        }
+        if(simulator){
+            simulator->close();
+        }
+    }
+
+    // Threshold scan over one stimulus: a run with reset per step against one run with a configuration timeline.
+    const std::vector<uint64_t> scan_thresholds = {0, 50, 100, 200};
+    if(access(design.c_str(), R_OK) != 0){
+        bench.skip("xsi/threshold_scan/runs", design + " not found");
+        bench.skip("xsi/threshold_scan/timeline", design + " not found");
+    }else if(only.empty() || std::string("xsi/threshold_scan/runs").find(only) != std::string::npos
+                            || std::string("xsi/threshold_scan/timeline").find(only) != std::string::npos){
+        const size_t n_channels = 8;
+        daphne_st_simulator::daphne_st_top_hdl_simulator simulator(design, kernel);
+        simulator.set_clk_sim_step(4000);
+        std::string config_file = write_configuration(base_config, n_channels, "inverted");
+        simulator.set_configuration(config_file);
+        unlink(config_file.c_str());
+        const daphne_st_simulator::self_trigger_configuration base = simulator.get_configuration();
+        std::vector<uint16_t> input_data;
+        daphne_st_simulator::daphne_st_waveform_generator generator(stimulus_configuration(stimuli[1]), n_channels);
+        generator.generate(input_data, xsi_samples);
+        const size_t step_samples = xsi_samples / scan_thresholds.size();
+        bench.run("xsi/threshold_scan/runs", [&]() {
+            scenario_result result;
+            for(size_t i = 0; i < scan_thresholds.size(); i++){
+                daphne_st_simulator::self_trigger_configuration step = base;
+                step.discrimination_threshold = scan_thresholds[i];
+                simulator.set_configuration(step);
+                std::vector<uint16_t> step_data;
+                for(size_t ch = 0; ch < n_channels; ch++){
+                    auto first = input_data.begin() + ch * xsi_samples + i * step_samples;
+                    step_data.insert(step_data.end(), first, first + step_samples);
+                }
+                simulator.run_simulation(step_data);
+                result.samples += step_samples * n_channels;
+                result.frames += simulator.get_decoded_frames().size();
+            }
+            return result;
+        });
+        bench.run("xsi/threshold_scan/timeline", [&]() {
+            std::vector<daphne_st_simulator::configuration_change> timeline;
+            for(size_t i = 0; i < scan_thresholds.size(); i++){
+                timeline.push_back({i * step_samples, base});
+                timeline.back().configuration.discrimination_threshold = scan_thresholds[i];
+            }
+            simulator.set_configuration(base);
+            simulator.set_configuration_timeline(timeline);
+            simulator.run_simulation(input_data);
+            simulator.clear_configuration_timeline();
+            return scenario_result{xsi_samples * n_channels, simulator.get_decoded_frames().size()};
+        });
+        simulator.close();
+    }
+
+    // External triggers at fixed rates on a pedestal stimulus: every frame comes from a ti_trigger strobe,
+    // so frames per trigger and channel falling below 1 maps where the output link saturates.
+    const std::vector<double> external_trigger_rates = {1.0e3, 1.0e4, 1.0e5};
+    for(const auto &rate : external_trigger_rates){
+        const std::string name = "xsi/external_trigger/" + std::to_string(uint64_t(rate)) + "Hz";
+        if(access(design.c_str(), R_OK) != 0){
+            bench.skip(name, design + " not found");
+            continue;
+        }
+        if(!only.empty() && name.find(only) == std::string::npos){
+            continue;
+        }
+        const size_t n_channels = 8;
+        daphne_st_simulator::daphne_st_top_hdl_simulator simulator(design, kernel);
+        simulator.set_clk_sim_step(4000);
+        std::string config_file = write_configuration(base_config, n_channels, "inverted");
+        simulator.set_configuration(config_file);
+        unlink(config_file.c_str());
+        std::vector<uint16_t> input_data;
+        daphne_st_simulator::daphne_st_waveform_generator generator(stimulus_configuration(stimuli[0]), n_channels);
+        generator.generate(input_data, xsi_samples);
+        daphne_st_simulator::trigger_scheduler_configuration triggers;
+        triggers.rate = rate;
+        simulator.set_external_triggers(triggers);
+        bench.run(name, [&]() {
+            simulator.run_simulation(input_data);
+            scenario_result result{xsi_samples * n_channels, simulator.get_decoded_frames().size()};
+            const size_t n_triggers = simulator.get_external_trigger_samples().size();
+            result.details = {{"trigger_rate", rate}, {"triggers", n_triggers},
+                              {"frames_per_trigger_and_channel", n_triggers ? double(result.frames) / (n_triggers * n_channels) : 0.0}};
+            return result;
+        });
+        simulator.close();
+    }
+
+    // Isolated XSI linking: simulators in dlmopen namespaces stepping on threads of this process,
+    // all reading the same input buffer. instance_limit opens namespaces until glibc refuses.
+    const std::vector<size_t> thread_counts = {1, 2, 4};
+    if(access(design.c_str(), R_OK) != 0){
+        for(const auto &n_threads : thread_counts){
+            bench.skip("xsi/isolated/" + std::to_string(n_threads) + "threads", design + " not found");
+        }
+        bench.skip("xsi/isolated/instance_limit", design + " not found");
+    }else{
+        const size_t n_channels = 8;
+        std::string config_file = write_configuration(base_config, n_channels, "inverted");
+        std::vector<uint16_t> input_data;
+        daphne_st_simulator::daphne_st_waveform_generator generator(stimulus_configuration(stimuli[1]), n_channels);
+        generator.generate(input_data, xsi_samples);
+        for(const auto &n_threads : thread_counts){
+            const std::string name = "xsi/isolated/" + std::to_string(n_threads) + "threads";
+            if(!only.empty() && name.find(only) == std::string::npos){
+                continue;
+            }
+            std::vector<std::unique_ptr<daphne_st_simulator::daphne_st_top_hdl_simulator>> simulators;
+            try{
+                for(size_t i = 0; i < n_threads; i++){
+                    simulators.push_back(std::make_unique<daphne_st_simulator::daphne_st_top_hdl_simulator>(design, kernel, daphne_st_simulator::xsi_linking::isolated));
+                    simulators.back()->set_clk_sim_step(4000);
+                    simulators.back()->set_configuration(config_file);
+                }
+            }
+            catch (const std::exception& e) {
+                bench.skip(name, e.what());
+                continue;
+            }
+            bench.run(name, [&]() {
+                std::vector<std::thread> threads;
+                for(auto &it : simulators){
+                    threads.emplace_back([&input_data, &it]() { it->run_simulation(input_data); });
+                }
+                scenario_result result;
+                for(size_t i = 0; i < n_threads; i++){
+                    threads[i].join();
+                    result.samples += xsi_samples * n_channels;
+                    result.frames += simulators[i]->get_decoded_frames().size();
+                }
+                // every instance saw the same stimulus, a difference means they were not isolated
+                bool identical = true;
+                for(const auto &it : simulators){
+                    identical = identical && it->get_simulation_stream() == simulators[0]->get_simulation_stream();
+                }
+                result.details = {{"threads", n_threads}, {"identical_streams", identical}};
+                return result;
+            });
+            for(auto &it : simulators){
+                it->close();
+            }
+        }
+        if(only.empty() || std::string("xsi/isolated/instance_limit").find(only) != std::string::npos){
+            bench.run("xsi/isolated/instance_limit", [&]() {
+                std::vector<std::unique_ptr<daphne_st_simulator::daphne_st_top_hdl_simulator>> simulators;
+                std::string error;
+                const uint64_t rss_before = rss_kb();
+                // glibc stops at 16 namespaces, the base one included
+                while(simulators.size() < 16){
+                    try{
+                        simulators.push_back(std::make_unique<daphne_st_simulator::daphne_st_top_hdl_simulator>(design, kernel, daphne_st_simulator::xsi_linking::isolated));
+                    }
+                    catch (const std::exception& e) {
+                        error = e.what();
+                        break;
+                    }
+                }
+                scenario_result result;
+                result.details = {{"instances", simulators.size()}, {"error", error},
+                                  {"rss_kb_per_instance", simulators.empty() ? 0 : (rss_kb() - rss_before) / simulators.size()}};
+                for(auto &it : simulators){
+                    it->close();
+                }
+                return result;
+            });
+        }
+        unlink(config_file.c_str());
+    }
+
+    nlohmann::json report;
+    report["xsi_samples"] = xsi_samples;
+    report["native_samples"] = native_samples;
+    report["scenarios"] = bench.get_results();
+    std::ofstream output(output_file);
+    if(!output.is_open()){
+        std::cerr << "ERROR: could not open " << output_file << std::endl;
+        return 1;
+    }
+    output << report.dump(4) << std::endl;
+    std::cerr << "Report written to " << output_file << std::endl;
+    return 0;
+}
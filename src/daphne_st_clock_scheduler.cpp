@@ -0,0 +1,47 @@
+#include "daphne_st_clock_scheduler.h"
+
+#include <stdexcept>
+
+uint64_t daphne_st_simulator::daphne_st_clock_scheduler::edge_time(const clock &c) const{
+    // 128 bits so n * units_per_second does not overflow on long runs
+    unsigned __int128 numerator = (unsigned __int128)c.next_edge * this->units_per_second;
+    return uint64_t(numerator / (2 * (unsigned __int128)c.frequency));
+}
+
+void daphne_st_simulator::daphne_st_clock_scheduler::reset(const uint64_t &units_per_second){
+    if(units_per_second == 0){
+        throw std::invalid_argument("The kernel time unit must be a positive fraction of a second");
+    }
+    this->units_per_second = units_per_second;
+    this->clocks.clear();
+    this->queue = decltype(this->queue)();
+    this->time = 0;
+}
+
+uint32_t daphne_st_simulator::daphne_st_clock_scheduler::add_clock(const uint64_t &frequency){
+    if(frequency == 0 || 2 * frequency > this->units_per_second){
+        throw std::invalid_argument("Clock frequency must be positive and its half period at least one kernel time unit");
+    }
+    uint32_t index = this->clocks.size();
+    this->clocks.push_back({frequency, 1});
+    const clock &c = this->clocks.back();
+    this->queue.push({this->edge_time(c), index, true});
+    return index;
+}
+
+uint64_t daphne_st_simulator::daphne_st_clock_scheduler::pop_edges(std::vector<clock_edge> &edges){
+    edges.clear();
+    if(this->queue.empty()){
+        throw std::logic_error("The clock scheduler has no clocks");
+    }
+    this->time = this->queue.top().time;
+    while(!this->queue.empty() && this->queue.top().time == this->time){
+        clock_edge edge = this->queue.top();
+        this->queue.pop();
+        edges.push_back(edge);
+        clock &c = this->clocks[edge.clock];
+        c.next_edge++;
+        this->queue.push({this->edge_time(c), edge.clock, (c.next_edge & 1) != 0});
+    }
+    return this->queue.top().time - this->time;
+}
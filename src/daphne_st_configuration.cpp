@@ -0,0 +1,103 @@
+#include "daphne_st_configuration.h"
+
+#include <fstream>
+#include <bitset>
+#include <stdexcept>
+
+namespace {
+
+nlohmann::json read_configuration_file(const std::string &configFile){
+    std::ifstream config_file(configFile);
+    if(!config_file.is_open()){
+        throw std::runtime_error("Error opening configuration file: " + configFile);
+    }
+    return nlohmann::json::parse(config_file);
+}
+
+uint16_t numeric_id(const nlohmann::json &value){
+    // det_id is written as a string in the DAQ configuration files
+    if(value.is_string()){
+        return uint16_t(std::stoul(value.get<std::string>()));
+    }
+    return value.get<uint16_t>();
+}
+
+}
+
+daphne_st_simulator::self_trigger_configuration daphne_st_simulator::self_trigger_configuration::from_file(const std::string &configFile, const size_t &device_index){
+    nlohmann::json config = read_configuration_file(configFile);
+    if(!config["devices"].is_array() || device_index >= config["devices"].size()){
+        throw std::out_of_range("Configuration file " + configFile + " has no device " + std::to_string(device_index));
+    }
+    return from_json(config["devices"][device_index]);
+}
+
+std::vector<daphne_st_simulator::self_trigger_configuration> daphne_st_simulator::self_trigger_configuration::devices_from_file(const std::string &configFile){
+    nlohmann::json config = read_configuration_file(configFile);
+    std::vector<self_trigger_configuration> devices;
+    for(auto &device : config["devices"]){
+        devices.push_back(from_json(device));
+    }
+    return devices;
+}
+
+daphne_st_simulator::self_trigger_configuration daphne_st_simulator::self_trigger_configuration::from_json(nlohmann::json &device){
+    using json = nlohmann::json;
+    json &selftrigger_config = device["self_trigger"];
+
+    self_trigger_configuration configuration;
+    if(device.contains("slot")){
+        configuration.slot_id = numeric_id(device["slot"]);
+    }
+    if(device.contains("crate")){
+        configuration.crate_id = numeric_id(device["crate"]);
+    }
+    if(device.contains("det_id")){
+        configuration.detector_id = numeric_id(device["det_id"]);
+    }
+    for(const auto &en_ch : selftrigger_config["enable_compensator"]){
+        configuration.enabled_compensator |= (1ULL << en_ch.get<int>());
+        configuration.input_channels.push_back(en_ch.get<int>());
+    }
+    for(const auto &en_ch : selftrigger_config["enable_inverter"]){
+        configuration.enabled_inverter |= (1ULL << en_ch.get<int>());
+    }
+    for(const auto &en_ch : device["channels"]["indices"]){
+        configuration.enabled_channels |= (1ULL << en_ch.get<int>());
+    }
+    configuration.filter_mode = selftrigger_config["filter_mode"].get<std::string>();
+    configuration.slope_mode = selftrigger_config["slope_mode"].get<std::string>();
+    configuration.slope_threshold = selftrigger_config["slope_threshold"].get<std::uint32_t>();
+    configuration.pedestal_length = selftrigger_config["pedestal_length"].get<std::uint32_t>();
+    configuration.spybuffer_channel = selftrigger_config["spybuffer_channel"].get<std::uint32_t>();
+    configuration.correlation_threshold = selftrigger_config["self_trigger_xcorr"]["correlation_threshold"].get<std::uint64_t>();
+    configuration.discrimination_threshold = selftrigger_config["self_trigger_xcorr"]["discrimination_threshold"].get<std::uint64_t>();
+    return configuration;
+}
+
+uint32_t daphne_st_simulator::self_trigger_configuration::filter_output_selector() const{
+    if(this->filter_mode == "compensated") {
+        return 0;
+    } else if(this->filter_mode == "inverted") {
+        return 1;
+    } else if(this->filter_mode == "xcorr") {
+        return 2;
+    } else if(this->filter_mode == "raw") {
+        return 3;
+    }
+    throw std::invalid_argument("Invalid filter mode configuration");
+}
+
+void daphne_st_simulator::self_trigger_configuration::print(std::ostream &os) const{
+    os << "Slot: " << this->slot_id << " Crate: " << this->crate_id << " Detector: " << this->detector_id << std::endl;
+    os << "Enabled compensator: " << std::bitset<64>(this->enabled_compensator) << std::endl;
+    os << "Enabled inverter: " << std::bitset<64>(this->enabled_inverter) << std::endl;
+    os << "Enabled channels: " << std::bitset<64>(this->enabled_channels) << std::endl;
+    os << "Filter mode: " << this->filter_mode << std::endl;
+    os << "Slope mode: " << this->slope_mode << std::endl;
+    os << "Slope threshold: " << this->slope_threshold << std::endl;
+    os << "Pedestal length: " << this->pedestal_length << std::endl;
+    os << "Spybuffer channel: " << this->spybuffer_channel << std::endl;
+    os << "Correlation threshold: " << this->correlation_threshold << std::endl;
+    os << "Discrimination threshold: " << this->discrimination_threshold << std::endl;
+}
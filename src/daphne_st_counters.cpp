@@ -0,0 +1,42 @@
+#include "daphne_st_counters.h"
+
+daphne_st_simulator::counter_metrics daphne_st_simulator::counter_metrics::from_snapshot(const counter_snapshot &snapshot, const uint64_t &n_samples, const uint64_t &enabled_inputs){
+    counter_metrics metrics;
+    metrics.seconds = double(n_samples) / 62.5e6;
+    for(int i = 0; i < 40; i++){
+        if(!((enabled_inputs >> i) & 1)){
+            continue;
+        }
+        metrics.triggers += snapshot.trigger_count[i];
+        metrics.packets += snapshot.packet_count[i];
+        metrics.trigger_rate[i] = metrics.seconds > 0.0 ? snapshot.trigger_count[i] / metrics.seconds : 0.0;
+        metrics.packet_trigger_ratio[i] = snapshot.trigger_count[i] > 0 ? double(snapshot.packet_count[i]) / snapshot.trigger_count[i] : 0.0;
+    }
+    metrics.sent = snapshot.send_count;
+    metrics.link_efficiency = metrics.packets > 0 ? double(metrics.sent) / metrics.packets : 0.0;
+    return metrics;
+}
+
+void daphne_st_simulator::counter_metrics::print_summary(std::ostream &os, const uint64_t &enabled_inputs) const{
+    os << "Triggers: " << this->triggers << " Packets: " << this->packets << " Sent: " << this->sent
+       << " Link efficiency: " << this->link_efficiency << std::endl;
+    for(int i = 0; i < 40; i++){
+        if((enabled_inputs >> i) & 1){
+            os << "  input " << i << " (ch_id " << 10 * (i / 8) + i % 8 << "): "
+               << this->trigger_rate[i] << " Hz, packet/trigger " << this->packet_trigger_ratio[i] << std::endl;
+        }
+    }
+}
+
+void daphne_st_simulator::write_counter_series_csv(std::ostream &os, const std::vector<counter_snapshot> &series){
+    os << "sample_index,timestamp,end_of_run";
+    for(int i = 0; i < 40; i++) os << ",trigger_" << i;
+    for(int i = 0; i < 40; i++) os << ",packet_" << i;
+    os << ",send_count\n";
+    for(const auto &snapshot : series){
+        os << snapshot.sample_index << "," << snapshot.timestamp << "," << snapshot.end_of_run;
+        for(const auto &it : snapshot.trigger_count) os << "," << it;
+        for(const auto &it : snapshot.packet_count) os << "," << it;
+        os << "," << snapshot.send_count << "\n";
+    }
+}
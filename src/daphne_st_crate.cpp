@@ -0,0 +1,129 @@
+#include "daphne_st_crate.h"
+#include "daphne_st_sim.h"
+
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace {
+
+enum record_kind : uint32_t { frame_record = 0, device_done_record = 1 };
+
+// What a worker sends back: every decoded frame, then one summary per device.
+struct crate_record{
+    uint32_t device_index;
+    uint32_t kind;
+    uint64_t frames;
+    uint64_t malformed_frames;
+    double seconds;
+    dunedaq::fddetdataformats::DAPHNEFrame frame;
+};
+
+}
+
+daphne_st_simulator::daphne_st_crate::daphne_st_crate(const std::string &design_libname, const std::string &simkernel_libname, const std::vector<self_trigger_configuration> &devices){
+    this->design_libname = design_libname;
+    this->simkernel_libname = simkernel_libname;
+    this->devices = devices;
+}
+
+daphne_st_simulator::daphne_st_crate::daphne_st_crate(const std::string &design_libname, const std::string &simkernel_libname, const std::string &configFile)
+    : daphne_st_crate(design_libname, simkernel_libname, self_trigger_configuration::devices_from_file(configFile)) {}
+
+void daphne_st_simulator::daphne_st_crate::run_worker(const std::vector<std::vector<uint16_t>> &inputs,
+                                                      const daphne_st_worker_pool::next_task_function &next_task,
+                                                      const daphne_st_worker_pool::send_function &send){
+    // one simulator per worker, reconfigured for every device it takes
+    daphne_st_top_hdl_simulator simulator(this->design_libname, this->simkernel_libname);
+    simulator.set_clk_sim_step(this->clk_sim_step);
+    crate_record record;
+    uint64_t index;
+    while(next_task(index)){
+        memset(&record, 0, sizeof(record));
+        record.device_index = index;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = false;
+        try{
+            simulator.set_configuration(this->devices[index]);
+            simulator.clear_simulation_stream();
+            simulator.run_simulation(inputs.size() == 1 ? inputs[0] : inputs[index]);
+            record.kind = frame_record;
+            for(const auto &frame : simulator.get_decoded_frames()){
+                record.frame = frame;
+                send(&record);
+            }
+            ok = true;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "ERROR: device " << index << " failed: " << e.what() << std::endl;
+        }
+        memset(&record.frame, 0, sizeof(record.frame));
+        record.kind = device_done_record;
+        record.frames = ok ? simulator.get_decoded_frames().size() : 0;
+        record.malformed_frames = ok ? simulator.get_malformed_frames() : 0;
+        record.seconds = ok ? std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() : -1.0;
+        send(&record);
+    }
+    simulator.close();
+}
+
+std::vector<daphne_st_simulator::crate_frame> daphne_st_simulator::daphne_st_crate::run(const std::vector<std::vector<uint16_t>> &inputs){
+    if(inputs.size() != 1 && inputs.size() != this->devices.size()){
+        throw std::invalid_argument("Expected one input per device or a single input for all devices");
+    }
+    for(size_t d = 0; d < this->devices.size(); d++){
+        const std::vector<uint16_t> &input = inputs.size() == 1 ? inputs[0] : inputs[d];
+        size_t n_channels = this->devices[d].input_channels.size();
+        if(n_channels == 0 || input.size() % n_channels != 0){
+            throw std::invalid_argument("Input data size does not match the number of enabled channels of device " + std::to_string(d));
+        }
+    }
+
+    std::vector<crate_frame> frames;
+    this->device_reports.assign(this->devices.size(), crate_device_report());
+    daphne_st_worker_pool::run(this->n_workers, this->devices.size(), sizeof(crate_record),
+        [&](const daphne_st_worker_pool::next_task_function &next_task, const daphne_st_worker_pool::send_function &send){
+            this->run_worker(inputs, next_task, send);
+        },
+        [&](const void* data){
+            const crate_record* record = static_cast<const crate_record*>(data);
+            if(record->device_index >= this->devices.size()){
+                return;
+            }
+            if(record->kind == frame_record){
+                frames.push_back({uint16_t(record->device_index), record->frame});
+            }else{
+                crate_device_report &report = this->device_reports[record->device_index];
+                report.ok = record->seconds >= 0.0;
+                report.frames = record->frames;
+                report.malformed_frames = record->malformed_frames;
+                report.seconds = report.ok ? record->seconds : 0.0;
+            }
+        });
+    for(size_t d = 0; d < this->device_reports.size(); d++){
+        if(!this->device_reports[d].ok){
+            std::cerr << "WARNING: device " << d << " (slot " << this->devices[d].slot_id << ") did not complete" << std::endl;
+        }
+    }
+
+    // frames of one device arrive in order, the devices interleave arbitrarily
+    std::stable_sort(frames.begin(), frames.end(), [](const crate_frame &a, const crate_frame &b){
+        uint64_t ta = a.frame.get_timestamp();
+        uint64_t tb = b.frame.get_timestamp();
+        if(ta != tb) return ta < tb;
+        if(a.device_index != b.device_index) return a.device_index < b.device_index;
+        return a.frame.get_channel() < b.frame.get_channel();
+    });
+    return frames;
+}
+
+void daphne_st_simulator::daphne_st_crate::write_frames(const std::string &filename, const std::vector<crate_frame> &frames){
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if(!file.is_open()){
+        throw std::runtime_error("Could not open frame output file: " + filename);
+    }
+    for(const auto &it : frames){
+        file.write(reinterpret_cast<const char*>(&it.frame), sizeof(it.frame));
+    }
+}
@@ -0,0 +1,314 @@
+#include "daphne_st_csv_loader.h"
+#include "daphne_st_mapped_file.h"
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+struct chunk_type{
+    const char* begin;
+    const char* end;
+    uint64_t lines = 0;     // all lines in the chunk, blank ones included
+    uint64_t rows = 0;      // non blank lines
+    uint64_t first_line = 0;
+    uint64_t first_row = 0;
+    std::vector<daphne_st_simulator::csv_value_error> errors;
+};
+
+struct worker_result{
+    uint64_t malformed_values = 0;
+    uint64_t out_of_range_values = 0;
+    uint64_t bad_rows = 0;
+};
+
+enum class parse_status { ok, malformed, out_of_range };
+
+constexpr uint64_t ascii_zeros = 0x3030303030303030ULL;
+
+inline const char* end_of_line(const char* p, const char* end){
+    const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    return nl == nullptr ? end : nl;
+}
+
+inline bool is_blank(const char* p, const char* end){
+    for(; p < end; p++){
+        if(*p != ' ' && *p != '\t' && *p != '\r'){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads 8 bytes starting at p. Bytes past end read as ',' so they never look like digits.
+inline uint64_t load_eight_bytes(const char* p, const char* end){
+    uint64_t word;
+    if(end - p >= 8){
+        memcpy(&word, p, 8);
+    }else{
+        char buffer[8];
+        memset(buffer, ',', 8);
+        memcpy(buffer, p, end - p);
+        memcpy(&word, buffer, 8);
+    }
+    return word;
+}
+
+// Number of leading ASCII digits in a little-endian 8 byte word.
+inline unsigned int count_leading_digits(const uint64_t &word){
+    uint64_t x = word ^ ascii_zeros;                   // digits become 0..9
+    uint64_t t = (x + 0x7676767676767676ULL) | x;      // high bit set for every byte >= 10
+    uint64_t non_digit = t & 0x8080808080808080ULL;
+    return non_digit == 0 ? 8 : __builtin_ctzll(non_digit) / 8;
+}
+
+// Converts exactly 8 ASCII digits (most significant in the lowest byte) to an integer.
+inline uint32_t parse_eight_digits(uint64_t word){
+    word = ((word & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    word = ((word & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    return static_cast<uint32_t>(((word & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32);
+}
+
+// Parses one field starting at p, leaving p on the separator (or end of line).
+inline parse_status parse_field(const char* &p, const char* end, const uint32_t &max_value, uint16_t &value){
+    while(p < end && (*p == ' ' || *p == '\t')) p++;
+    bool negative = false;
+    if(p < end && (*p == '+' || *p == '-')){
+        negative = (*p == '-');
+        p++;
+    }
+    uint64_t result = 0;
+    unsigned int total_digits = 0;
+    while(true){
+        uint64_t word = load_eight_bytes(p, end);
+        unsigned int n = count_leading_digits(word);
+        if(n == 0) break;
+        if(n < 8){
+            // left pad with '0' so the digits sit at the top of the word
+            word = (word << (8 * (8 - n))) | (ascii_zeros >> (8 * n));
+        }
+        if(total_digits < 10){
+            static const uint64_t powers_of_ten[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+            result = result * powers_of_ten[n] + parse_eight_digits(word);
+        }
+        total_digits += n;
+        p += n;
+        if(n < 8) break;
+    }
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if(total_digits == 0 || (p < end && *p != ',')){
+        while(p < end && *p != ',') p++;
+        return parse_status::malformed;
+    }
+    if(negative && result != 0){
+        return parse_status::out_of_range;
+    }
+    if(total_digits > 9 || result > max_value){
+        return parse_status::out_of_range;
+    }
+    value = static_cast<uint16_t>(result);
+    return parse_status::ok;
+}
+
+inline void record_error(chunk_type &chunk, const size_t &max_errors, const uint64_t &line, const uint16_t &column,
+                         const daphne_st_simulator::csv_value_error::reason_type &reason){
+    if(chunk.errors.size() < max_errors){
+        chunk.errors.push_back({line, column, reason});
+    }
+}
+
+}
+
+void daphne_st_simulator::csv_load_report::print_summary(std::ostream &os) const{
+    os << "CSV load: " << this->rows << " rows x " << this->columns << " columns";
+    if(this->ok()){
+        os << ", no errors." << std::endl;
+        return;
+    }
+    os << ", " << this->malformed_values << " malformed values, "
+       << this->out_of_range_values << " out of range values, "
+       << this->bad_rows << " rows with a wrong number of columns." << std::endl;
+    static const char* reason_names[] = {"malformed", "out of range", "missing columns", "extra columns"};
+    for(const auto &it : this->errors){
+        os << "  line " << it.line << ", column " << it.column << ": " << reason_names[it.reason] << std::endl;
+    }
+    uint64_t total = this->malformed_values + this->out_of_range_values + this->bad_rows;
+    if(total > this->errors.size()){
+        os << "  ... " << (total - this->errors.size()) << " more not listed." << std::endl;
+    }
+}
+
+daphne_st_simulator::daphne_st_csv_loader::daphne_st_csv_loader(const std::string &filename, const bool &skip_header){
+    this->filename = filename;
+    this->skip_header = skip_header;
+}
+
+daphne_st_simulator::csv_load_report daphne_st_simulator::daphne_st_csv_loader::load(std::vector<uint16_t> &channel_major, const size_t &n_channels) const{
+    csv_load_report report;
+    daphne_st_mapped_file file(this->filename);
+    channel_major.clear();
+
+    const char* begin = file.data();
+    const char* end = file.data() + file.size();
+    uint64_t line_offset = 1;
+    if(this->skip_header && begin < end){
+        const char* eol = end_of_line(begin, end);
+        begin = (eol < end) ? eol + 1 : end;
+        line_offset++;
+    }
+
+    // the first data row sets the number of columns
+    const char* p = begin;
+    while(p < end){
+        const char* eol = end_of_line(p, end);
+        if(!is_blank(p, eol)){
+            report.columns = 1 + std::count(p, eol, ',');
+            break;
+        }
+        p = (eol < end) ? eol + 1 : end;
+    }
+    if(report.columns == 0){
+        return report;
+    }
+    size_t output_channels = (n_channels == 0) ? report.columns : n_channels;
+    if(report.columns != output_channels && report.columns != 1){
+        throw std::invalid_argument("CSV file " + this->filename + " has " + std::to_string(report.columns) +
+                                    " columns, expected 1 or " + std::to_string(output_channels));
+    }
+    const bool broadcast = (report.columns == 1);
+
+    unsigned int n_threads = this->n_threads;
+    if(n_threads == 0){
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // split on newline boundaries, a few chunks per thread for load balancing
+    const size_t min_chunk_size = 1 << 20;
+    size_t n_chunks = std::min<size_t>(n_threads * 4, (end - begin) / min_chunk_size + 1);
+    std::vector<chunk_type> chunks;
+    const char* chunk_begin = begin;
+    for(size_t i = 1; i <= n_chunks && chunk_begin < end; i++){
+        const char* chunk_end = (i == n_chunks) ? end : begin + (end - begin) * i / n_chunks;
+        if(chunk_end < chunk_begin) chunk_end = chunk_begin;
+        if(chunk_end < end){
+            chunk_end = end_of_line(chunk_end, end);
+            chunk_end = (chunk_end < end) ? chunk_end + 1 : end;
+        }
+        chunks.push_back({chunk_begin, chunk_end});
+        chunk_begin = chunk_end;
+    }
+
+    auto run_on_pool = [&](const auto &job){
+        std::atomic<size_t> next_chunk{0};
+        std::vector<std::thread> pool;
+        unsigned int n_workers = std::min<size_t>(n_threads, chunks.size());
+        for(unsigned int t = 0; t < n_workers; t++){
+            pool.emplace_back([&, t](){
+                for(size_t c = next_chunk++; c < chunks.size(); c = next_chunk++){
+                    job(t, chunks[c]);
+                }
+            });
+        }
+        for(auto &it : pool){
+            it.join();
+        }
+    };
+
+    // pass 1: count rows per chunk
+    run_on_pool([](const unsigned int &, chunk_type &chunk){
+        const char* p = chunk.begin;
+        while(p < chunk.end){
+            const char* eol = end_of_line(p, chunk.end);
+            chunk.lines++;
+            if(!is_blank(p, eol)) chunk.rows++;
+            p = eol + 1;
+        }
+    });
+    uint64_t rows = 0;
+    uint64_t lines = line_offset;
+    for(auto &it : chunks){
+        it.first_row = rows;
+        it.first_line = lines;
+        rows += it.rows;
+        lines += it.lines;
+    }
+    report.rows = rows;
+    channel_major.resize(output_channels * rows);
+
+    // pass 2: parse straight into the channel-major buffer
+    std::vector<worker_result> results(std::min<size_t>(n_threads, chunks.size()));
+    uint16_t* out = channel_major.data();
+    const uint16_t columns = report.columns;
+    const uint32_t max_value = this->max_value;
+    const size_t max_errors = this->max_reported_errors;
+    run_on_pool([&](const unsigned int &t, chunk_type &chunk){
+        worker_result &result = results[t];
+        uint64_t row = chunk.first_row;
+        uint64_t line = chunk.first_line;
+        const char* p = chunk.begin;
+        while(p < chunk.end){
+            const char* eol = end_of_line(p, chunk.end);
+            if(is_blank(p, eol)){
+                p = eol + 1;
+                line++;
+                continue;
+            }
+            uint16_t column = 0;
+            bool bad_row = false;
+            while(true){
+                uint16_t value = 0;
+                if(column >= columns){
+                    record_error(chunk, max_errors, line, column, csv_value_error::extra_columns);
+                    bad_row = true;
+                    break;
+                }
+                parse_status status = parse_field(p, eol, max_value, value);
+                if(status == parse_status::malformed){
+                    result.malformed_values++;
+                    record_error(chunk, max_errors, line, column, csv_value_error::malformed);
+                }else if(status == parse_status::out_of_range){
+                    result.out_of_range_values++;
+                    record_error(chunk, max_errors, line, column, csv_value_error::out_of_range);
+                    value = 0;
+                }
+                if(broadcast){
+                    for(size_t ch = 0; ch < output_channels; ch++){
+                        out[ch * rows + row] = value;
+                    }
+                }else{
+                    out[column * rows + row] = value;
+                }
+                column++;
+                if(p >= eol) break;
+                p++; // skip ','
+            }
+            if(!bad_row && column < columns){
+                record_error(chunk, max_errors, line, column, csv_value_error::missing_columns);
+                bad_row = true;
+                for(uint16_t c = column; c < columns; c++){
+                    out[c * rows + row] = 0;
+                }
+            }
+            if(bad_row) result.bad_rows++;
+            p = eol + 1;
+            row++;
+            line++;
+        }
+    });
+
+    for(auto &it : results){
+        report.malformed_values += it.malformed_values;
+        report.out_of_range_values += it.out_of_range_values;
+        report.bad_rows += it.bad_rows;
+    }
+    // chunks are in file order, so the first errors of the file come first
+    for(const auto &it : chunks){
+        for(const auto &error : it.errors){
+            if(report.errors.size() >= this->max_reported_errors) break;
+            report.errors.push_back(error);
+        }
+    }
+    return report;
+}
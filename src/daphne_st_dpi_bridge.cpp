@@ -0,0 +1,43 @@
+#include "daphne_st_dpi_bridge.h"
+
+#include <cstring>
+#include <algorithm>
+
+thread_local daphne_st_simulator::daphne_st_dpi_bridge* daphne_st_simulator::daphne_st_dpi_bridge::active = nullptr;
+
+void daphne_st_simulator::daphne_st_dpi_bridge::set_input(const uint16_t* input_data, const size_t &length, const std::vector<uint16_t> &channels){
+    this->input_data = input_data;
+    this->length = length;
+    this->position = 0;
+    this->input_slots = channels;
+    this->words.clear();
+}
+
+int daphne_st_simulator::daphne_st_dpi_bridge::fetch_block(int16_t* block, const int &max_samples){
+    const size_t n_samples = std::min(size_t(max_samples), this->length - this->position);
+    memset(block, 0, n_samples * 40 * sizeof(int16_t));
+    for(size_t ch = 0; ch < this->input_slots.size(); ch++){
+        const uint16_t* source = this->input_data + ch * this->length + this->position;
+        int16_t* column = block + this->input_slots[ch];
+        for(size_t i = 0; i < n_samples; i++){
+            column[40 * i] = source[i];
+        }
+    }
+    this->position += n_samples;
+    return n_samples;
+}
+
+int daphne_st_dpi_fetch_block(short* block, int max_samples){
+    daphne_st_simulator::daphne_st_dpi_bridge* bridge = daphne_st_simulator::daphne_st_dpi_bridge::get_active();
+    if(bridge == nullptr){
+        return 0;
+    }
+    return bridge->fetch_block(block, max_samples);
+}
+
+void daphne_st_dpi_push_word(unsigned long long cycle, unsigned int word, unsigned int k){
+    daphne_st_simulator::daphne_st_dpi_bridge* bridge = daphne_st_simulator::daphne_st_dpi_bridge::get_active();
+    if(bridge != nullptr){
+        bridge->push_word(cycle, word, k);
+    }
+}
@@ -0,0 +1,124 @@
+#include "daphne_st_event_log.h"
+
+#include <stdexcept>
+#include <iostream>
+
+daphne_st_simulator::daphne_st_event_log::daphne_st_event_log(const size_t &capacity){
+    size_t size = 2;
+    while(size < capacity) size <<= 1;
+    this->cells = std::vector<cell>(size);
+    this->mask = size - 1;
+    for(size_t i = 0; i < size; i++){
+        this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    this->start_time = std::chrono::steady_clock::now();
+}
+
+daphne_st_simulator::daphne_st_event_log::~daphne_st_event_log(){
+    this->close();
+}
+
+void daphne_st_simulator::daphne_st_event_log::open(const std::string &filename, const event_log_format &format, const event_level &min_level){
+    this->close();
+    std::ios::openmode mode = std::ios::out | std::ios::trunc;
+    if(format == event_log_format::binary){
+        mode |= std::ios::binary;
+    }
+    this->output.open(filename, mode);
+    if(!this->output.is_open()){
+        throw std::runtime_error("Could not open event log file: " + filename);
+    }
+    this->format = format;
+    this->min_level = min_level;
+    this->written_events = 0;
+    this->dropped_events.store(0, std::memory_order_relaxed);
+    this->start_time = std::chrono::steady_clock::now();
+    this->stop.store(false, std::memory_order_relaxed);
+    this->drain_thread = std::thread(&daphne_st_event_log::drain, this);
+    this->active.store(true, std::memory_order_release);
+}
+
+void daphne_st_simulator::daphne_st_event_log::close(){
+    if(!this->drain_thread.joinable()){
+        return;
+    }
+    this->active.store(false, std::memory_order_release);
+    this->stop.store(true, std::memory_order_release);
+    this->drain_thread.join();
+    this->output.close();
+    if(this->dropped_events.load(std::memory_order_relaxed) > 0){
+        std::cerr << "WARNING: event log queue overflowed, "
+                  << this->dropped_events.load(std::memory_order_relaxed) << " events dropped" << std::endl;
+    }
+}
+
+bool daphne_st_simulator::daphne_st_event_log::dequeue(event_record &record){
+    // single consumer: only the drain thread advances dequeue_position
+    size_t position = this->dequeue_position.load(std::memory_order_relaxed);
+    cell &c = this->cells[position & this->mask];
+    if(c.sequence.load(std::memory_order_acquire) != position + 1){
+        return false;
+    }
+    record = c.record;
+    c.sequence.store(position + this->mask + 1, std::memory_order_release);
+    this->dequeue_position.store(position + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void daphne_st_simulator::daphne_st_event_log::write_record(const event_record &record){
+    if(this->format == event_log_format::binary){
+        this->output.write(reinterpret_cast<const char*>(&record), sizeof(event_record));
+    }else{
+        this->output << "{\"time_ns\":" << record.time_ns
+                     << ",\"level\":\"" << level_name(record.level)
+                     << "\",\"type\":\"" << type_name(record.type)
+                     << "\",\"cycle\":" << record.cycle
+                     << ",\"value\":" << record.value << "}\n";
+    }
+    this->written_events++;
+}
+
+void daphne_st_simulator::daphne_st_event_log::drain(){
+    event_record record;
+    for(;;){
+        bool stopping = this->stop.load(std::memory_order_acquire);
+        bool any = false;
+        while(this->dequeue(record)){
+            this->write_record(record);
+            any = true;
+        }
+        if(stopping){
+            // producers stopped before stop was raised, the queue is now empty for good
+            break;
+        }
+        if(!any){
+            this->output.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    this->output.flush();
+}
+
+const char* daphne_st_simulator::daphne_st_event_log::level_name(const event_level &level){
+    switch(level){
+        case event_level::debug:   return "debug";
+        case event_level::info:    return "info";
+        case event_level::warning: return "warning";
+        case event_level::error:   return "error";
+    }
+    return "unknown";
+}
+
+const char* daphne_st_simulator::daphne_st_event_log::type_name(const event_type &type){
+    switch(type){
+        case event_type::sof:          return "sof";
+        case event_type::eof:          return "eof";
+        case event_type::idle_timeout: return "idle_timeout";
+        case event_type::config:       return "config";
+        case event_type::run_start:    return "run_start";
+        case event_type::run_end:      return "run_end";
+        case event_type::drained:      return "drained";
+        case event_type::external_trigger: return "external_trigger";
+    }
+    return "unknown";
+}
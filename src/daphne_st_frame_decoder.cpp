@@ -0,0 +1,29 @@
+#include "daphne_st_frame_decoder.h"
+
+static_assert(sizeof(dunedaq::fddetdataformats::DAPHNEFrame) == 466 * sizeof(uint32_t),
+              "DAPHNEFrame no longer matches the 466 word payload written by stc.vhd");
+
+void daphne_st_simulator::daphne_st_frame_decoder::push(const uint32_t* words, const size_t &n_words){
+    for(size_t i = 0; i < n_words; i++){
+        this->push(words[i]);
+    }
+}
+
+void daphne_st_simulator::daphne_st_frame_decoder::push(const uint32_t* words, const frame_marker* markers, const size_t &n_words){
+    for(size_t i = 0; i < n_words; i++){
+        this->push(words[i], markers[i]);
+    }
+}
+
+void daphne_st_simulator::daphne_st_frame_decoder::reset(){
+    this->frames.clear();
+    this->words_in_frame = 0;
+    this->in_frame = false;
+    this->malformed_frames = 0;
+}
+
+std::vector<dunedaq::fddetdataformats::DAPHNEFrame> daphne_st_simulator::daphne_st_frame_decoder::decode(const std::vector<uint32_t> &stream){
+    daphne_st_frame_decoder decoder;
+    decoder.push(stream.data(), stream.size());
+    return std::move(decoder.frames);
+}
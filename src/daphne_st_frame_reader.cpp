@@ -0,0 +1,202 @@
+#include "daphne_st_frame_reader.h"
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+void daphne_st_simulator::frame_load_report::print_summary(std::ostream &os) const{
+    os << "Frame load: " << this->frames_used << " of " << this->frames_in_file << " frames used, "
+       << this->samples_per_channel << " samples per channel starting at timestamp " << this->first_timestamp << std::endl;
+    os << "  " << this->frames_unselected_channel << " frames of unselected channels, "
+       << this->frames_outside_window << " frames outside the time window, "
+       << this->gap_samples << " pedestal samples, "
+       << this->overlapping_samples << " overlapping samples dropped." << std::endl;
+    if(this->trailing_bytes != 0){
+        os << "  " << this->trailing_bytes << " trailing bytes do not form a complete frame." << std::endl;
+    }
+}
+
+daphne_st_simulator::daphne_st_frame_reader::daphne_st_frame_reader(const std::string &filename){
+    this->filename = filename;
+}
+
+void daphne_st_simulator::daphne_st_frame_reader::unpack_adc_words(const frame_type::word_t* adc_words, uint16_t* samples){
+    // 7 words hold exactly 16 samples, so every group starts word aligned
+    for(int group = 0; group < frame_type::s_num_adcs / 16; group++){
+        const frame_type::word_t* w = adc_words + 7 * group;
+        uint16_t* s = samples + 16 * group;
+        uint64_t buffer = 0;
+        int bits = 0;
+        for(int i = 0; i < 16; i++){
+            if(bits < frame_type::s_bits_per_adc){
+                buffer |= uint64_t(*w++) << bits;
+                bits += frame_type::s_bits_per_word;
+            }
+            s[i] = buffer & 0x3FFF;
+            buffer >>= frame_type::s_bits_per_adc;
+            bits -= frame_type::s_bits_per_adc;
+        }
+    }
+}
+
+daphne_st_simulator::frame_load_report daphne_st_simulator::daphne_st_frame_reader::index_frames(const daphne_st_mapped_file &file, const std::vector<uint16_t> &channels,
+                                                                                              std::vector<std::vector<frame_segment>> &segments) const{
+    frame_load_report report;
+    const size_t frame_size = sizeof(frame_type);
+    const frame_type* frames = reinterpret_cast<const frame_type*>(file.data());
+    report.frames_in_file = file.size() / frame_size;
+    report.trailing_bytes = file.size() % frame_size;
+    segments.assign(channels.size(), {});
+
+    // frame channel -> output channel
+    std::vector<int> channel_lookup(64, -1);
+    for(size_t i = 0; i < channels.size(); i++){
+        if(channels[i] >= 64){
+            throw std::invalid_argument("Frame channel " + std::to_string(channels[i]) + " does not fit the 6-bit channel field");
+        }
+        channel_lookup[channels[i]] = i;
+    }
+
+    struct frame_entry{
+        uint64_t timestamp;
+        uint64_t index;
+    };
+    std::vector<std::vector<frame_entry>> per_channel(channels.size());
+    for(uint64_t i = 0; i < report.frames_in_file; i++){
+        int output_channel = channel_lookup[frames[i].get_channel()];
+        if(output_channel < 0){
+            report.frames_unselected_channel++;
+            continue;
+        }
+        uint64_t timestamp = frames[i].get_timestamp();
+        if(timestamp < this->window_begin || timestamp >= this->window_end){
+            report.frames_outside_window++;
+            continue;
+        }
+        per_channel[output_channel].push_back({timestamp, i});
+    }
+
+    uint64_t first_timestamp = UINT64_MAX;
+    uint64_t end_timestamp = 0;
+    for(auto &it : per_channel){
+        std::stable_sort(it.begin(), it.end(), [](const frame_entry &a, const frame_entry &b){ return a.timestamp < b.timestamp; });
+        if(!it.empty()){
+            first_timestamp = std::min(first_timestamp, it.front().timestamp);
+            end_timestamp = std::max(end_timestamp, it.back().timestamp + frame_type::s_num_adcs);
+        }
+    }
+    if(first_timestamp == UINT64_MAX){
+        return report;
+    }
+    report.first_timestamp = first_timestamp;
+    report.samples_per_channel = end_timestamp - first_timestamp;
+    const uint64_t length = report.samples_per_channel;
+
+    // resolve overlaps up front, so every sample comes from one frame at most
+    for(size_t ch = 0; ch < per_channel.size(); ch++){
+        uint64_t covered = 0;
+        for(const auto &it : per_channel[ch]){
+            uint64_t start = it.timestamp - first_timestamp;
+            uint64_t end = start + frame_type::s_num_adcs;
+            if(end <= covered){
+                report.overlapping_samples += frame_type::s_num_adcs;
+                continue;
+            }
+            uint32_t skip = 0;
+            if(start < covered){
+                skip = covered - start;
+                report.overlapping_samples += skip;
+            }else{
+                report.gap_samples += start - covered;
+            }
+            segments[ch].push_back({start, &frames[it.index], skip});
+            report.frames_used++;
+            covered = end;
+        }
+        report.gap_samples += length - covered;
+    }
+    return report;
+}
+
+daphne_st_simulator::frame_load_report daphne_st_simulator::daphne_st_frame_reader::load(std::vector<uint16_t> &channel_major, const std::vector<uint16_t> &channels) const{
+    daphne_st_mapped_file file(this->filename);
+    std::vector<std::vector<frame_segment>> segments;
+    frame_load_report report = this->index_frames(file, channels, segments);
+    channel_major.clear();
+    if(report.frames_used == 0){
+        return report;
+    }
+    const uint64_t length = report.samples_per_channel;
+    channel_major.assign(channels.size() * length, this->pedestal);
+
+    // the segments are disjoint, so the parallel unpack writes disjoint ranges
+    struct unpack_job{
+        const frame_type* frame;
+        uint16_t* destination;
+        uint32_t skip;
+    };
+    std::vector<unpack_job> jobs;
+    jobs.reserve(report.frames_used);
+    for(size_t ch = 0; ch < segments.size(); ch++){
+        for(const auto &it : segments[ch]){
+            jobs.push_back({it.frame, channel_major.data() + ch * length + it.start, it.skip});
+        }
+    }
+
+    unsigned int n_threads = this->n_threads;
+    if(n_threads == 0){
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const size_t jobs_per_batch = 256;
+    std::atomic<size_t> next_job{0};
+    auto worker = [&](){
+        uint16_t samples[frame_type::s_num_adcs];
+        for(size_t first = next_job.fetch_add(jobs_per_batch); first < jobs.size(); first = next_job.fetch_add(jobs_per_batch)){
+            size_t last = std::min(first + jobs_per_batch, jobs.size());
+            for(size_t j = first; j < last; j++){
+                const unpack_job &job = jobs[j];
+                if(job.skip == 0){
+                    unpack_adc_words(job.frame->adc_words, job.destination);
+                }else{
+                    unpack_adc_words(job.frame->adc_words, samples);
+                    memcpy(job.destination + job.skip, samples + job.skip, (frame_type::s_num_adcs - job.skip) * sizeof(uint16_t));
+                }
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for(unsigned int t = 1; t < std::min<size_t>(n_threads, jobs.size() / jobs_per_batch + 1); t++){
+        pool.emplace_back(worker);
+    }
+    worker();
+    for(auto &it : pool){
+        it.join();
+    }
+    return report;
+}
+
+daphne_st_simulator::frame_load_report daphne_st_simulator::daphne_st_frame_reader::open_source(input_source_ptr &source, const std::vector<uint16_t> &channels) const{
+    auto file = std::make_shared<const daphne_st_mapped_file>(this->filename);
+    std::vector<std::vector<frame_segment>> segments;
+    frame_load_report report = this->index_frames(*file, channels, segments);
+    source = std::make_shared<daphne_st_frame_source>(std::move(file), std::move(segments), report.samples_per_channel, this->pedestal);
+    return report;
+}
+
+void daphne_st_simulator::daphne_st_frame_source::read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const{
+    using frame_type = dunedaq::fddetdataformats::DAPHNEFrame;
+    std::fill(out, out + count, this->pedestal);
+    const std::vector<frame_segment> &channel_segments = this->segments[channel];
+    const uint64_t last = first + count;
+    // segments are disjoint and in start order, so their ends are ordered too
+    auto it = std::upper_bound(channel_segments.begin(), channel_segments.end(), first,
+                               [](const uint64_t &sample, const frame_segment &segment){ return sample < segment.start + frame_type::s_num_adcs; });
+    uint16_t samples[frame_type::s_num_adcs];
+    for(; it != channel_segments.end() && it->start + it->skip < last; ++it){
+        daphne_st_frame_reader::unpack_adc_words(it->frame->adc_words, samples);
+        const uint64_t begin = std::max(first, it->start + it->skip);
+        const uint64_t end = std::min<uint64_t>(last, it->start + frame_type::s_num_adcs);
+        std::copy(samples + (begin - it->start), samples + (end - it->start), out + (begin - first));
+    }
+}
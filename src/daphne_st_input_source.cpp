@@ -0,0 +1,78 @@
+#include "daphne_st_input_source.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+daphne_st_simulator::daphne_st_buffer_source::daphne_st_buffer_source(std::vector<uint16_t> data, const size_t &n_channels){
+    if(n_channels == 0 || data.size() % n_channels != 0){
+        throw std::invalid_argument("Input data size does not match the number of channels");
+    }
+    this->owned = std::make_shared<const std::vector<uint16_t>>(std::move(data));
+    this->data = this->owned->data();
+    this->n_channels = n_channels;
+    this->length = this->owned->size() / n_channels;
+}
+
+void daphne_st_simulator::daphne_st_buffer_source::read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const{
+    const uint16_t* source = this->data + channel * this->length + first;
+    std::copy(source, source + count, out);
+}
+
+void daphne_st_simulator::daphne_st_pedestal_source::read(const size_t & /*channel*/, const uint64_t & /*first*/, const size_t &count, uint16_t* out) const{
+    std::fill(out, out + count, this->value);
+}
+
+daphne_st_simulator::daphne_st_repeat_source::daphne_st_repeat_source(input_source_ptr segment, const uint64_t &count)
+    : segment(std::move(segment)), count(count){
+    if(this->segment == nullptr){
+        throw std::invalid_argument("A repeat source needs a segment");
+    }
+}
+
+void daphne_st_simulator::daphne_st_repeat_source::read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const{
+    const uint64_t period = this->segment->get_length();
+    uint64_t offset = first % period;
+    size_t done = 0;
+    while(done < count){
+        const size_t n = std::min<uint64_t>(count - done, period - offset);
+        this->segment->read(channel, offset, n, out + done);
+        done += n;
+        offset = 0;
+    }
+}
+
+daphne_st_simulator::daphne_st_broadcast_source::daphne_st_broadcast_source(input_source_ptr waveform, const size_t &n_channels)
+    : waveform(std::move(waveform)), n_channels(n_channels){
+    if(this->waveform == nullptr){
+        throw std::invalid_argument("A broadcast source needs a waveform");
+    }
+}
+
+daphne_st_simulator::daphne_st_concat_source::daphne_st_concat_source(std::vector<input_source_ptr> segments)
+    : segments(std::move(segments)){
+    if(this->segments.empty()){
+        throw std::invalid_argument("A concat source needs at least one segment");
+    }
+    uint64_t end = 0;
+    for(const auto &it : this->segments){
+        if(it == nullptr || it->get_number_of_channels() != this->segments.front()->get_number_of_channels()){
+            throw std::invalid_argument("Concatenated segments must have the same number of channels");
+        }
+        end += it->get_length();
+        this->segment_end.push_back(end);
+    }
+}
+
+void daphne_st_simulator::daphne_st_concat_source::read(const size_t &channel, const uint64_t &first, const size_t &count, uint16_t* out) const{
+    size_t segment = std::upper_bound(this->segment_end.begin(), this->segment_end.end(), first) - this->segment_end.begin();
+    uint64_t position = first;
+    size_t done = 0;
+    while(done < count){
+        const uint64_t segment_begin = segment == 0 ? 0 : this->segment_end[segment - 1];
+        const size_t n = std::min<uint64_t>(count - done, this->segment_end[segment] - position);
+        this->segments[segment]->read(channel, position - segment_begin, n, out + done);
+        done += n;
+        position += n;
+        segment++;
+    }
+}
@@ -0,0 +1,77 @@
+#include "daphne_st_lane_batch.h"
+#include "daphne_st_sim.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+size_t daphne_st_simulator::daphne_st_lane_batch::add(const lane_experiment &experiment){
+    if(this->experiments.size() == max_lanes){
+        throw std::length_error("All 40 lanes of the batch are in use");
+    }
+    if(experiment.waveform.empty()){
+        throw std::invalid_argument("A lane experiment needs at least one sample");
+    }
+    this->experiments.push_back(experiment);
+    return this->experiments.size() - 1;
+}
+
+daphne_st_simulator::self_trigger_configuration daphne_st_simulator::daphne_st_lane_batch::lane_configuration() const{
+    self_trigger_configuration configuration = this->base;
+    configuration.input_channels.clear();
+    configuration.enabled_channels = 0;
+    configuration.enabled_compensator = 0;
+    configuration.enabled_inverter = 0;
+    for(size_t lane = 0; lane < this->experiments.size(); lane++){
+        configuration.input_channels.push_back(lane);
+        configuration.enabled_channels |= 1ULL << lane;
+        if(this->experiments[lane].compensator){
+            configuration.enabled_compensator |= 1ULL << lane;
+        }
+        if(this->experiments[lane].inverter){
+            configuration.enabled_inverter |= 1ULL << lane;
+        }
+    }
+    return configuration;
+}
+
+std::vector<uint16_t> daphne_st_simulator::daphne_st_lane_batch::lane_input() const{
+    size_t length = 0;
+    for(const auto &it : this->experiments){
+        length = std::max(length, it.waveform.size());
+    }
+    std::vector<uint16_t> input_data;
+    input_data.reserve(length * this->experiments.size());
+    for(const auto &it : this->experiments){
+        input_data.insert(input_data.end(), it.waveform.begin(), it.waveform.end());
+        input_data.insert(input_data.end(), length - it.waveform.size(), it.waveform.back());
+    }
+    return input_data;
+}
+
+std::vector<daphne_st_simulator::lane_result> daphne_st_simulator::daphne_st_lane_batch::run(daphne_st_top_hdl_simulator &simulator) const{
+    if(this->experiments.empty()){
+        throw std::invalid_argument("The lane batch has no experiments");
+    }
+    simulator.set_configuration(this->lane_configuration());
+    simulator.run_simulation(this->lane_input());
+    return demultiplex(simulator.get_decoded_frames(), this->experiments.size());
+}
+
+std::vector<daphne_st_simulator::lane_result> daphne_st_simulator::daphne_st_lane_batch::demultiplex(const std::vector<dunedaq::fddetdataformats::DAPHNEFrame> &frames, const size_t &n_lanes){
+    std::vector<lane_result> results(n_lanes);
+    // channel id 10*afe + channel back to the lane (input 8*afe + channel), -1 for channels without one
+    int lane_of_channel[64];
+    std::fill(lane_of_channel, lane_of_channel + 64, -1);
+    for(size_t lane = 0; lane < n_lanes; lane++){
+        results[lane].input = lane;
+        results[lane].channel_id = 10 * (lane / 8) + lane % 8;
+        lane_of_channel[results[lane].channel_id] = lane;
+    }
+    for(const auto &frame : frames){
+        int lane = lane_of_channel[frame.get_channel() & 0x3F];
+        if(lane >= 0){
+            results[lane].frames.push_back(frame);
+        }
+    }
+    return results;
+}
@@ -0,0 +1,104 @@
+#include "daphne_st_profiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+void daphne_st_simulator::daphne_st_profiler::begin_run(){
+    this->start_time = std::chrono::steady_clock::now();
+    this->start_ticks = now();
+}
+
+void daphne_st_simulator::daphne_st_profiler::end_run(const uint64_t &samples, const uint64_t &fclk_cycles){
+    this->add(run_simulation, now() - this->start_ticks);
+    this->run_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start_time).count();
+    this->samples += samples;
+    this->fclk_cycles += fclk_cycles;
+}
+
+void daphne_st_simulator::daphne_st_profiler::reset(){
+    *this = daphne_st_profiler();
+}
+
+const char* daphne_st_simulator::daphne_st_profiler::phase_name(const phase &p){
+    switch(p){
+        case run_simulation: return "run_simulation";
+        case xsi_run:        return "xsi_run";
+        case xsi_put_value:  return "xsi_put_value";
+        case xsi_get_value:  return "xsi_get_value";
+        case input_wait:     return "input_wait";
+        case output_wait:    return "output_wait";
+        case drain:          return "drain";
+        case load_input:     return "load_input";
+        case write_output:   return "write_output";
+        default:             return "unknown";
+    }
+}
+
+double daphne_st_simulator::daphne_st_profiler::ticks_per_second() const{
+    if(this->run_seconds <= 0.0){
+        return 0.0;
+    }
+    return double(this->ticks[run_simulation]) / this->run_seconds;
+}
+
+double daphne_st_simulator::daphne_st_profiler::seconds(const phase &p) const{
+    double rate = this->ticks_per_second();
+    return rate > 0.0 ? double(this->ticks[p]) / rate : 0.0;
+}
+
+double daphne_st_simulator::daphne_st_profiler::samples_per_second() const{
+    return this->run_seconds > 0.0 ? double(this->samples) / this->run_seconds : 0.0;
+}
+
+double daphne_st_simulator::daphne_st_profiler::fclk_cycles_per_second() const{
+    return this->run_seconds > 0.0 ? double(this->fclk_cycles) / this->run_seconds : 0.0;
+}
+
+void daphne_st_simulator::daphne_st_profiler::print_summary(std::ostream &os) const{
+    std::ios format(nullptr);
+    format.copyfmt(os);
+    // kernel time not spent inside XSI or waiting on the other stages
+    double total = this->seconds(run_simulation);
+    double bookkeeping = total - this->seconds(xsi_run) - this->seconds(xsi_put_value) - this->seconds(xsi_get_value)
+                               - this->seconds(input_wait) - this->seconds(output_wait);
+    os << std::left << std::setw(16) << "phase" << std::right << std::setw(14) << "calls"
+       << std::setw(14) << "seconds" << std::setw(10) << "% run" << std::setw(14) << "ns/call" << "\n";
+    for(size_t i = 0; i < number_of_phases; i++){
+        phase p = static_cast<phase>(i);
+        double s = this->seconds(p);
+        os << std::left << std::setw(16) << phase_name(p) << std::right << std::setw(14) << this->calls[i]
+           << std::setw(14) << std::fixed << std::setprecision(4) << s
+           << std::setw(10) << std::setprecision(1) << (total > 0.0 ? 100.0 * s / total : 0.0)
+           << std::setw(14) << std::setprecision(1) << (this->calls[i] > 0 ? 1e9 * s / this->calls[i] : 0.0) << "\n";
+    }
+    os << std::left << std::setw(16) << "bookkeeping" << std::right << std::setw(14) << "-"
+       << std::setw(14) << std::setprecision(4) << bookkeeping
+       << std::setw(10) << std::setprecision(1) << (total > 0.0 ? 100.0 * bookkeeping / total : 0.0) << "\n";
+    os << "Samples: " << this->samples << " (" << std::setprecision(0) << this->samples_per_second() << " samples/s), "
+       << "fclk cycles: " << this->fclk_cycles << " (" << this->fclk_cycles_per_second() << " cycles/s)" << std::endl;
+    os.copyfmt(format);
+}
+
+nlohmann::json daphne_st_simulator::daphne_st_profiler::to_json() const{
+    nlohmann::json report;
+    report["run_seconds"] = this->run_seconds;
+    report["ticks_per_second"] = this->ticks_per_second();
+    report["samples"] = this->samples;
+    report["fclk_cycles"] = this->fclk_cycles;
+    report["samples_per_second"] = this->samples_per_second();
+    report["fclk_cycles_per_second"] = this->fclk_cycles_per_second();
+    for(size_t i = 0; i < number_of_phases; i++){
+        phase p = static_cast<phase>(i);
+        report["phases"][phase_name(p)] = {{"calls", this->calls[i]}, {"ticks", this->ticks[i]}, {"seconds", this->seconds(p)}};
+    }
+    return report;
+}
+
+void daphne_st_simulator::daphne_st_profiler::write_json(const std::string &filename) const{
+    std::ofstream file(filename);
+    if(!file.is_open()){
+        throw std::runtime_error("Could not open profile report file: " + filename);
+    }
+    file << this->to_json().dump(4) << std::endl;
+}
@@ -0,0 +1,184 @@
+#include "daphne_st_signal_tracer.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+daphne_st_simulator::daphne_st_signal_tracer::~daphne_st_signal_tracer(){
+    this->close();
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::open(const std::string &filename){
+    this->close();
+    this->output.open(filename, std::ios::trunc);
+    if(!this->output.is_open()){
+        throw std::runtime_error("Could not open trace file: " + filename);
+    }
+    this->signals.clear();
+    this->words_per_cycle = 0;
+    this->header_written = false;
+    this->have_last = false;
+    this->clear_history();
+    this->record_until = 0;
+    this->last_run_cycle = 0;
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::close(){
+    if(this->output.is_open()){
+        if(!this->header_written){
+            this->write_header();
+        }
+        this->output.close();
+    }
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::add_signal(const std::string &name, const uint16_t &width){
+    if(this->header_written){
+        throw std::logic_error("Signals must be added to the tracer before the first cycle is recorded");
+    }
+    // VCD identifiers from the printable range '!'..'~'
+    std::string id;
+    size_t n = this->signals.size();
+    do{
+        id += char('!' + n % 94);
+        n /= 94;
+    }while(n != 0);
+    this->signals.push_back({name, width, this->words_per_cycle, id});
+    this->words_per_cycle += (width + 31) / 32;
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::set_cycle_range(const uint64_t &first, const uint64_t &last){
+    this->mode = trace_window_mode::cycle_range;
+    this->first_cycle = first;
+    this->last_cycle = last;
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::set_trigger_window(const uint64_t &pre, const uint64_t &post){
+    this->mode = trace_window_mode::around_trigger;
+    this->pre_cycles = pre;
+    this->post_cycles = post;
+    this->clear_history();
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::clear_history(){
+    this->history.clear();
+    this->history_cycle.clear();
+    this->history_run_cycle.clear();
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::write_header(){
+    this->output << "$timescale 1 ns $end\n$scope module st40_top $end\n";
+    for(const auto &s : this->signals){
+        this->output << "$var wire " << s.width << " " << s.id << " " << s.name << " $end\n";
+    }
+    this->output << "$upscope $end\n$enddefinitions $end\n";
+    this->header_written = true;
+    this->last_written.assign(this->words_per_cycle, {0, 0});
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::write_value(const signal &s, const s_xsi_vlog_logicval* value){
+    // aVal/bVal: 00 = 0, 10 = 1, 01 = z, 11 = x
+    static const char symbols[4] = {'0', '1', 'z', 'x'};
+    if(s.width == 1){
+        this->output << symbols[(value[0].aVal & 1) | ((value[0].bVal & 1) << 1)] << s.id << "\n";
+        return;
+    }
+    std::string bits;
+    bits.reserve(s.width);
+    for(int bit = s.width - 1; bit >= 0; bit--){
+        const s_xsi_vlog_logicval &word = value[bit / 32];
+        bits += symbols[((word.aVal >> (bit % 32)) & 1) | (((word.bVal >> (bit % 32)) & 1) << 1)];
+    }
+    // leading zeros can be dropped
+    size_t first = std::min(bits.find_first_not_of('0'), bits.size() - 1);
+    this->output << "b" << bits.substr(first) << " " << s.id << "\n";
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::write_cycle(const uint64_t &cycle, const s_xsi_vlog_logicval* values){
+    const bool full_dump = !this->have_last || cycle != this->last_written_cycle + 1;
+    bool time_written = false;
+    for(const auto &s : this->signals){
+        const size_t n_words = (s.width + 31) / 32;
+        const s_xsi_vlog_logicval* value = values + s.first_word;
+        if(!full_dump && memcmp(value, &this->last_written[s.first_word], n_words * sizeof(s_xsi_vlog_logicval)) == 0){
+            continue;
+        }
+        if(!time_written){
+            this->output << "#" << cycle * this->ns_per_cycle << "\n";
+            time_written = true;
+        }
+        this->write_value(s, value);
+    }
+    std::copy(values, values + this->words_per_cycle, this->last_written.begin());
+    this->have_last = true;
+    this->last_written_cycle = cycle;
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::write_gap(const uint64_t &cycle){
+    // the window just closed: everything is unknown until the next one
+    this->output << "#" << cycle * this->ns_per_cycle << "\n";
+    for(const auto &s : this->signals){
+        if(s.width == 1){
+            this->output << "x" << s.id << "\n";
+        }else{
+            this->output << "bx " << s.id << "\n";
+        }
+    }
+    this->have_last = false;
+}
+
+void daphne_st_simulator::daphne_st_signal_tracer::record(const uint64_t &cycle, const uint64_t &run_cycle, const s_xsi_vlog_logicval* values, const bool &trigger){
+    if(!this->header_written){
+        this->write_header();
+    }
+    const bool just_left = this->have_last && this->last_written_cycle + 1 == cycle;
+    switch(this->mode){
+    case trace_window_mode::all:
+        this->write_cycle(cycle, values);
+        break;
+    case trace_window_mode::cycle_range:
+        if(run_cycle >= this->first_cycle && run_cycle < this->last_cycle){
+            this->write_cycle(cycle, values);
+        }else if(just_left){
+            this->write_gap(cycle);
+        }
+        break;
+    case trace_window_mode::around_trigger:
+        if(run_cycle < this->last_run_cycle){
+            // a new run, its run cycles start again
+            this->clear_history();
+            this->record_until = 0;
+        }
+        this->last_run_cycle = run_cycle;
+        if(trigger){
+            // oldest first, only the pre_cycles run cycles ahead of the trigger
+            for(size_t i = 0; i < this->history_cycle.size(); i++){
+                if(this->history_run_cycle[i] + this->pre_cycles >= run_cycle){
+                    this->history_record.assign(this->history.begin() + i * this->words_per_cycle,
+                                                this->history.begin() + (i + 1) * this->words_per_cycle);
+                    this->write_cycle(this->history_cycle[i], this->history_record.data());
+                }
+            }
+            this->clear_history();
+            this->record_until = run_cycle + this->post_cycles + 1;
+        }
+        if(run_cycle < this->record_until){
+            this->write_cycle(cycle, values);
+        }else{
+            if(just_left){
+                this->write_gap(cycle);
+            }
+            if(this->pre_cycles != 0){
+                this->history.insert(this->history.end(), values, values + this->words_per_cycle);
+                this->history_cycle.push_back(cycle);
+                this->history_run_cycle.push_back(run_cycle);
+                while(this->history_run_cycle.front() + this->pre_cycles < run_cycle){
+                    this->history.erase(this->history.begin(), this->history.begin() + this->words_per_cycle);
+                    this->history_cycle.pop_front();
+                    this->history_run_cycle.pop_front();
+                }
+            }
+        }
+        break;
+    }
+}
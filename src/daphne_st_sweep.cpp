@@ -0,0 +1,139 @@
+#include "daphne_st_sweep.h"
+#include "daphne_st_sim.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// What a worker sends back per point.
+struct point_record{
+    uint64_t index;
+    uint64_t ok;
+    uint64_t frames;
+    uint64_t malformed_frames;
+    uint64_t output_words;
+    double seconds;
+    uint64_t frames_per_channel[64];
+};
+
+}
+
+std::vector<daphne_st_simulator::self_trigger_configuration> daphne_st_simulator::sweep_grid::expand(const self_trigger_configuration &base) const{
+    auto axis = [](const auto &values, const auto &base_value){
+        using value_type = typename std::decay_t<decltype(values)>::value_type;
+        return values.empty() ? std::vector<value_type>{base_value} : values;
+    };
+    std::vector<self_trigger_configuration> points;
+    for(const auto &filter_mode : axis(this->filter_mode, base.filter_mode)){
+        for(const auto &discrimination_threshold : axis(this->discrimination_threshold, base.discrimination_threshold)){
+            for(const auto &correlation_threshold : axis(this->correlation_threshold, base.correlation_threshold)){
+                for(const auto &pedestal_length : axis(this->pedestal_length, base.pedestal_length)){
+                    for(const auto &slope_threshold : axis(this->slope_threshold, base.slope_threshold)){
+                        self_trigger_configuration point = base;
+                        point.filter_mode = filter_mode;
+                        point.discrimination_threshold = discrimination_threshold;
+                        point.correlation_threshold = correlation_threshold;
+                        point.pedestal_length = pedestal_length;
+                        point.slope_threshold = slope_threshold;
+                        points.push_back(point);
+                    }
+                }
+            }
+        }
+    }
+    return points;
+}
+
+daphne_st_simulator::daphne_st_sweep::daphne_st_sweep(const std::string &design_libname, const std::string &simkernel_libname){
+    this->design_libname = design_libname;
+    this->simkernel_libname = simkernel_libname;
+}
+
+void daphne_st_simulator::daphne_st_sweep::run_worker(const std::vector<self_trigger_configuration> &points, const std::vector<uint16_t> &input_data,
+                                                      const daphne_st_worker_pool::next_task_function &next_task,
+                                                      const daphne_st_worker_pool::send_function &send){
+    daphne_st_top_hdl_simulator simulator(this->design_libname, this->simkernel_libname);
+    simulator.set_clk_sim_step(this->clk_sim_step);
+    uint64_t index;
+    while(next_task(index)){
+        point_record record;
+        memset(&record, 0, sizeof(record));
+        record.index = index;
+        auto start = std::chrono::steady_clock::now();
+        try{
+            simulator.set_configuration(points[index]);
+            simulator.clear_simulation_stream();
+            simulator.run_simulation(input_data);
+            for(const auto &frame : simulator.get_decoded_frames()){
+                record.frames_per_channel[frame.get_channel() & 0x3F]++;
+            }
+            record.frames = simulator.get_decoded_frames().size();
+            record.malformed_frames = simulator.get_malformed_frames();
+            record.output_words = simulator.get_simulation_stream().size();
+            record.ok = 1;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "ERROR: sweep point " << index << " failed: " << e.what() << std::endl;
+        }
+        record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        send(&record);
+    }
+    simulator.close();
+}
+
+std::vector<daphne_st_simulator::sweep_point_result> daphne_st_simulator::daphne_st_sweep::run(const self_trigger_configuration &base, const sweep_grid &grid,
+                                                                                                 const std::vector<uint16_t> &input_data){
+    std::vector<self_trigger_configuration> points = grid.expand(base);
+    std::vector<sweep_point_result> results(points.size());
+    for(size_t i = 0; i < points.size(); i++){
+        results[i].configuration = points[i];
+    }
+    size_t received = 0;
+    daphne_st_worker_pool::run(this->n_workers, points.size(), sizeof(point_record),
+        [&](const daphne_st_worker_pool::next_task_function &next_task, const daphne_st_worker_pool::send_function &send){
+            this->run_worker(points, input_data, next_task, send);
+        },
+        [&](const void* data){
+            const point_record* record = static_cast<const point_record*>(data);
+            if(record->index >= results.size()){
+                return;
+            }
+            sweep_point_result &result = results[record->index];
+            result.ok = record->ok != 0;
+            result.frames = record->frames;
+            result.malformed_frames = record->malformed_frames;
+            result.output_words = record->output_words;
+            result.seconds = record->seconds;
+            std::copy(std::begin(record->frames_per_channel), std::end(record->frames_per_channel), result.frames_per_channel.begin());
+            received++;
+        });
+    if(received != points.size()){
+        std::cerr << "WARNING: " << points.size() - received << " of " << points.size() << " sweep points were not reported" << std::endl;
+    }
+    return results;
+}
+
+void daphne_st_simulator::daphne_st_sweep::write_csv(std::ostream &os, const std::vector<sweep_point_result> &results){
+    os << "filter_mode,slope_threshold,pedestal_length,correlation_threshold,discrimination_threshold,ok,frames,malformed_frames,output_words,seconds";
+    for(int ch = 0; ch < 48; ch++){
+        if(ch % 10 < 8){
+            os << ",frames_ch" << ch;
+        }
+    }
+    os << "\n";
+    for(const auto &result : results){
+        const self_trigger_configuration &c = result.configuration;
+        os << c.filter_mode << "," << c.slope_threshold << "," << c.pedestal_length << ","
+           << c.correlation_threshold << "," << c.discrimination_threshold << ","
+           << result.ok << "," << result.frames << "," << result.malformed_frames << ","
+           << result.output_words << "," << result.seconds;
+        for(int ch = 0; ch < 48; ch++){
+            if(ch % 10 < 8){
+                os << "," << result.frames_per_channel[ch];
+            }
+        }
+        os << "\n";
+    }
+}
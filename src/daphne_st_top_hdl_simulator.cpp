@@ -1,10 +1,19 @@
 #include "daphne_st_sim.h"
 
-daphne_st_simulator::daphne_st_top_hdl_simulator::daphne_st_top_hdl_simulator(const std::string &design_libname, const std::string &simkernel_libname){
+daphne_st_simulator::daphne_st_top_hdl_simulator::daphne_st_top_hdl_simulator(const std::string &design_libname, const std::string &simkernel_libname)
+    : daphne_st_top_hdl_simulator(design_libname, simkernel_libname, xsi_linking::shared){
+}
+
+daphne_st_simulator::daphne_st_top_hdl_simulator::daphne_st_top_hdl_simulator(const std::string &design_libname, const std::string &simkernel_libname, const xsi_linking &linking){
     try{
         this->design_libname = design_libname;
         this->simkernel_libname = simkernel_libname;
-        this->loader = std::make_unique<Xsi::Loader>(this->design_libname, this->simkernel_libname);
+        this->linking = linking;
+        if(linking == xsi_linking::isolated){
+            this->loader = std::make_unique<daphne_st_xsi_isolated_backend>(this->design_libname, this->simkernel_libname);
+        }else{
+            this->loader = std::make_unique<daphne_st_xsi_shared_backend>(this->design_libname, this->simkernel_libname);
+        }
         this->info.logFileName = NULL;
         this->info.wdbFileName = NULL;
         this->loader->open(&this->info);
@@ -21,7 +30,7 @@ daphne_st_simulator::daphne_st_top_hdl_simulator::daphne_st_top_hdl_simulator(co
     try{
         this->design_libname = design_libname;
         this->simkernel_libname = simkernel_libname;
-        this->loader = std::make_unique<Xsi::Loader>(this->design_libname, this->simkernel_libname);
+        this->loader = std::make_unique<daphne_st_xsi_shared_backend>(this->design_libname, this->simkernel_libname);
         char wdbName[] = "debug_waveforms.wdb";
         this->info.logFileName = NULL;
         this->info.wdbFileName = wdbName;
@@ -36,6 +45,8 @@ daphne_st_simulator::daphne_st_top_hdl_simulator::daphne_st_top_hdl_simulator(co
 }
 
 daphne_st_simulator::daphne_st_top_hdl_simulator::~daphne_st_top_hdl_simulator(){
+    this->event_log.close();
+    this->signal_tracer.close();
     this->loader->close();
 }
 
@@ -354,13 +365,35 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::get_module_port_numbers()
         }
         std::cout << "Port name: " << it.first << " -- Port number: " << it.second.port_number << std::endl;
     }
+    this->aclk_port = this->port_map["aclk"].port_number;
+    this->fclk_port = this->port_map["fclk"].port_number;
+    this->oeiclk_port = this->port_map["oeiclk"].port_number;
+    this->dout_port = this->port_map["dout"].port_number;
+    this->kout_port = this->port_map["kout"].port_number;
+    this->timestamp_port = this->port_map["timestamp"].port_number;
+    this->rcount_addr_port = this->port_map["Rcount_addr"].port_number;
+    this->rcount_port = this->port_map["Rcount"].port_number;
+    this->spybuffer_port = this->port_map["st_40_selftrigger_4_spybuffer"].port_number;
+    // only st40_top_dpi_wrapper has it, and it must be low for the port-driven clocks to reach st40_top
+    this->dpi_mode_port = this->loader->get_port_number("dpi_mode");
+    if(this->dpi_mode_port >= 0){
+        this->xsi_put_value(this->dpi_mode_port, &this->zero_val);
+    }
+    this->update_enabled_input_ports();
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::update_enabled_input_ports(){
+    this->enabled_input_ports.clear();
+    for(const auto &ch : this->enabled_channels){
+        this->enabled_input_ports.push_back(this->port_map[this->signal_input_map[ch]].port_number);
+    }
 }
 
 void daphne_st_simulator::daphne_st_top_hdl_simulator::set_port_initial_values(){
     for(auto& it : this->port_map){
         if(it.second.port_type == 0) {
             std::cout << "Setting port: " << it.first << " number: " << it.second.port_number <<" to value: " << logic_val_to_string(&this->port_values[it.first][0], this->port_map[it.first].port_size) << std::endl;
-            this->loader->put_value(it.second.port_number, this->port_values[it.first].data());
+            this->xsi_put_value(it.second.port_number, this->port_values[it.first].data());
         }else{
             continue;
         }
@@ -374,7 +407,7 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::set_port_value(const std:
         std::cerr << "ERROR: " << port_name << " not found" << std::endl;
         exit(1);
     }
-    this->loader->put_value(port_num, this->port_values[port_name].data());
+    this->xsi_put_value(port_num, this->port_values[port_name].data());
 }
 
 void daphne_st_simulator::daphne_st_top_hdl_simulator::get_port_value(const std::string &port_name){
@@ -384,7 +417,7 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::get_port_value(const std:
         std::cerr << "ERROR: " << port_name << " not found" << std::endl;
         exit(1);
     }
-    this->loader->get_value(port_num, this->port_values[port_name].data());
+    this->xsi_get_value(port_num, this->port_values[port_name].data());
 }
 
 void daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_a_clock(){
@@ -392,22 +425,28 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_a_clock(){
     // aclk is 62.5 Mhz and fclk will be considered doubled to 125 Mhz
     // so we will step aclk every 16 ns and fclk every 8 ns
     // constants 
-    this->loader->put_value(this->port_map["aclk"].port_number, &this->zero_val);
-    this->loader->put_value(this->port_map["fclk"].port_number, &this->zero_val);
-    this->loader->put_value(this->port_map["oeiclk"].port_number, &this->zero_val);
-    this->loader->run(this->clk_sim_step);
-    this->loader->put_value(this->port_map["aclk"].port_number, &this->zero_val);
-    this->loader->put_value(this->port_map["fclk"].port_number, &this->one_val);
-    this->loader->put_value(this->port_map["oeiclk"].port_number, &this->one_val);
-    this->loader->run(this->clk_sim_step);
-    this->loader->put_value(this->port_map["aclk"].port_number, &this->one_val);
-    this->loader->put_value(this->port_map["fclk"].port_number, &this->zero_val);
-    this->loader->put_value(this->port_map["oeiclk"].port_number, &this->zero_val);
-    this->loader->run(this->clk_sim_step);
-    this->loader->put_value(this->port_map["aclk"].port_number, &this->one_val);
-    this->loader->put_value(this->port_map["fclk"].port_number, &this->one_val);
-    this->loader->put_value(this->port_map["oeiclk"].port_number, &this->one_val);
-    this->loader->run(this->clk_sim_step);
+    if(this->scheduled_clocks){
+        while(!((this->step_clock_edges() >> this->aclk_clock) & 1)){
+        }
+        return;
+    }
+    this->xsi_put_value(this->aclk_port, &this->zero_val);
+    this->xsi_put_value(this->fclk_port, &this->zero_val);
+    this->xsi_put_value(this->oeiclk_port, &this->zero_val);
+    this->advance_timestamp();
+    this->xsi_run(this->clk_sim_step);
+    this->xsi_put_value(this->aclk_port, &this->zero_val);
+    this->xsi_put_value(this->fclk_port, &this->one_val);
+    this->xsi_put_value(this->oeiclk_port, &this->one_val);
+    this->xsi_run(this->clk_sim_step);
+    this->xsi_put_value(this->aclk_port, &this->one_val);
+    this->xsi_put_value(this->fclk_port, &this->zero_val);
+    this->xsi_put_value(this->oeiclk_port, &this->zero_val);
+    this->xsi_run(this->clk_sim_step);
+    this->xsi_put_value(this->aclk_port, &this->one_val);
+    this->xsi_put_value(this->fclk_port, &this->one_val);
+    this->xsi_put_value(this->oeiclk_port, &this->one_val);
+    this->xsi_run(this->clk_sim_step);
 }
 
 void daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_f_clock(){
@@ -415,28 +454,76 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_f_clock(){
     // aclk is 62.5 Mhz and fclk will be considered doubled to 125 Mhz
     // so we will step aclk every 16 ns and fclk every 8 ns
     // constants
+    if(this->scheduled_clocks){
+        while(!((this->step_clock_edges() >> this->fclk_clock) & 1)){
+        }
+        return;
+    }
     if(!this->clock_tilt_flag){
-        this->loader->put_value(this->port_map["aclk"].port_number, &this->zero_val);
-        this->loader->put_value(this->port_map["fclk"].port_number, &this->zero_val);
-        this->loader->put_value(this->port_map["oeiclk"].port_number, &this->zero_val);
-        this->loader->run(this->clk_sim_step);
-        this->loader->put_value(this->port_map["aclk"].port_number, &this->zero_val);
-        this->loader->put_value(this->port_map["fclk"].port_number, &this->one_val);
-        this->loader->put_value(this->port_map["oeiclk"].port_number, &this->one_val);
-        this->loader->run(this->clk_sim_step);
+        this->xsi_put_value(this->aclk_port, &this->zero_val);
+        this->xsi_put_value(this->fclk_port, &this->zero_val);
+        this->xsi_put_value(this->oeiclk_port, &this->zero_val);
+        this->advance_timestamp();
+        this->xsi_run(this->clk_sim_step);
+        this->xsi_put_value(this->aclk_port, &this->zero_val);
+        this->xsi_put_value(this->fclk_port, &this->one_val);
+        this->xsi_put_value(this->oeiclk_port, &this->one_val);
+        this->xsi_run(this->clk_sim_step);
     }else{
-        this->loader->put_value(this->port_map["aclk"].port_number, &this->one_val);
-        this->loader->put_value(this->port_map["fclk"].port_number, &this->zero_val);
-        this->loader->put_value(this->port_map["oeiclk"].port_number, &this->zero_val);
-        this->loader->run(this->clk_sim_step);
-        this->loader->put_value(this->port_map["aclk"].port_number, &this->one_val);
-        this->loader->put_value(this->port_map["fclk"].port_number, &this->one_val);
-        this->loader->put_value(this->port_map["oeiclk"].port_number, &this->one_val);
-        this->loader->run(this->clk_sim_step);
+        this->xsi_put_value(this->aclk_port, &this->one_val);
+        this->xsi_put_value(this->fclk_port, &this->zero_val);
+        this->xsi_put_value(this->oeiclk_port, &this->zero_val);
+        this->xsi_run(this->clk_sim_step);
+        this->xsi_put_value(this->aclk_port, &this->one_val);
+        this->xsi_put_value(this->fclk_port, &this->one_val);
+        this->xsi_put_value(this->oeiclk_port, &this->one_val);
+        this->xsi_run(this->clk_sim_step);
     }
     this->clock_tilt_flag = !this->clock_tilt_flag;
 }
 
+uint32_t daphne_st_simulator::daphne_st_top_hdl_simulator::step_clock_edges(){
+    // applies the edges due now and runs the kernel up to the next ones; returns a mask of the clocks that rose
+    const uint64_t run_time = this->clock_scheduler.pop_edges(this->clock_edges);
+    const std::pair<int, uint32_t> ports[3] = {{this->aclk_port, this->aclk_clock}, {this->fclk_port, this->fclk_clock}, {this->oeiclk_port, this->oeiclk_clock}};
+    uint32_t rose = 0;
+    for(const auto &edge : this->clock_edges){
+        for(const auto &it : ports){
+            if(it.second == edge.clock){
+                this->xsi_put_value(it.first, edge.rising ? &this->one_val : &this->zero_val);
+            }
+        }
+        if(edge.rising){
+            rose |= 1u << edge.clock;
+            if(edge.clock == this->oeiclk_clock){
+                this->oeiclk_edges++;
+            }
+        }else if(edge.clock == this->aclk_clock){
+            this->advance_timestamp();
+        }
+    }
+    this->xsi_run(run_time);
+    return rose;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_clock_frequencies(const uint64_t &aclk, const uint64_t &fclk, const uint64_t &oeiclk){
+    const uint64_t oeiclk_frequency = oeiclk == 0 ? fclk : oeiclk;
+    this->clock_tilt_flag = false;
+    if(aclk == 62500000 && fclk == 125000000 && oeiclk_frequency == fclk){
+        this->scheduled_clocks = false;
+        return;
+    }
+    // clk_sim_step kernel units are 4 ns
+    this->clock_scheduler.reset(this->clk_sim_step * 250000000);
+    this->aclk_clock = this->clock_scheduler.add_clock(aclk);
+    this->fclk_clock = this->clock_scheduler.add_clock(fclk);
+    this->oeiclk_clock = oeiclk_frequency == fclk ? this->fclk_clock : this->clock_scheduler.add_clock(oeiclk_frequency);
+    this->xsi_put_value(this->aclk_port, &this->zero_val);
+    this->xsi_put_value(this->fclk_port, &this->zero_val);
+    this->xsi_put_value(this->oeiclk_port, &this->zero_val);
+    this->scheduled_clocks = true;
+}
+
 void daphne_st_simulator::daphne_st_top_hdl_simulator::run_n_cycles(const int & n_cycles, const std::string & which_clock){
     // this function is used to run the simulation for n cycles
     for(int i = 0; i < n_cycles; i++){
@@ -451,94 +538,93 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::run_n_cycles(const int &
     }
 }
 
+void daphne_st_simulator::daphne_st_top_hdl_simulator::advance_timestamp(){
+    // called while aclk is low: puts the value the next aclk rising edge samples, then steps the counter
+    if(this->run_input_done){
+        // past the input the drain cycles keep counting samples; the kernel loop sets its own
+        this->run_sample_index++;
+    }
+    if(this->timestamp_counter != this->timestamp_written){
+        if((this->timestamp_counter ^ this->timestamp_written) >> 32){
+            this->timestamp_value[1].aVal = uint32_t(this->timestamp_counter >> 32);
+        }
+        this->timestamp_value[0].aVal = uint32_t(this->timestamp_counter);
+        this->xsi_put_value(this->timestamp_port, this->timestamp_value);
+        this->timestamp_written = this->timestamp_counter;
+    }
+    if(this->timestamp_denominator == 1){
+        this->timestamp_counter += this->timestamp_numerator;
+    }else{
+        this->timestamp_fraction += this->timestamp_numerator;
+        this->timestamp_counter += this->timestamp_fraction / this->timestamp_denominator;
+        this->timestamp_fraction %= this->timestamp_denominator;
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::restart_timestamp(){
+    this->timestamp_counter = this->timestamp_start;
+    this->timestamp_fraction = 0;
+    // set_port_initial_values() may have zeroed the port since the last write, force the first one
+    this->timestamp_written = ~this->timestamp_start;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_timestamp_ticks_per_aclk(const uint64_t &numerator, const uint64_t &denominator){
+    if(numerator == 0 || denominator == 0){
+        throw std::invalid_argument("Timestamp ticks per aclk cycle must be a positive ratio");
+    }
+    this->timestamp_numerator = numerator;
+    this->timestamp_denominator = denominator;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_a_clock_only(){
+    // one aclk cycle with fclk and oeiclk held, a single run() per half period
+    if(this->scheduled_clocks){
+        // the edges of the other clocks are queued, they cannot be skipped
+        this->cycle_a_clock();
+        return;
+    }
+    this->xsi_put_value(this->aclk_port, &this->zero_val);
+    this->advance_timestamp();
+    this->xsi_run(2 * this->clk_sim_step);
+    this->xsi_put_value(this->aclk_port, &this->one_val);
+    this->xsi_run(2 * this->clk_sim_step);
+}
+
+uint32_t daphne_st_simulator::daphne_st_top_hdl_simulator::get_reset_depth() const{
+    if(this->reset_type == reset_mode::full){
+        return full_reset_cycles;
+    }
+    // The delay lines have no reset, they are flushed with the input held during reset so the
+    // first frames of a run never carry samples of the previous one. Everything else resets
+    // within a few registered stages, the FIFOs needing the longest.
+    uint32_t signal_delay = (this->configuration.pedestal_length / 8) & 0x1F;
+    return std::max(delay_line_taps + signal_delay + 1, trigger_latency) + fifo_reset_cycles + reset_sync_stages;
+}
+
 void daphne_st_simulator::daphne_st_top_hdl_simulator::reset_design(){
     // this function is used to reset the design
-    this->loader->put_value(this->port_map["reset_aclk"].port_number, &this->one_val);
-    this->loader->put_value(this->port_map["reset_fclk"].port_number, &this->one_val);
-    this->run_n_cycles(320, "aclk");
-    this->loader->put_value(this->port_map["reset_aclk"].port_number, &this->zero_val);
-    this->loader->put_value(this->port_map["reset_fclk"].port_number, &this->zero_val);
+    uint32_t depth = this->get_reset_depth();
+    this->xsi_put_value(this->port_map["reset_aclk"].port_number, &this->one_val);
+    this->xsi_put_value(this->port_map["reset_fclk"].port_number, &this->one_val);
+    if(this->reset_type == reset_mode::full){
+        this->run_n_cycles(depth, "aclk");
+    }else{
+        // the fclk side (FIFO read port, output FSM) only needs the last cycles
+        uint32_t all_clock_cycles = fifo_reset_cycles + reset_sync_stages;
+        for(uint32_t i = 0; i < depth - all_clock_cycles; i++){
+            this->cycle_a_clock_only();
+        }
+        this->run_n_cycles(all_clock_cycles, "aclk");
+    }
+    this->xsi_put_value(this->port_map["reset_aclk"].port_number, &this->zero_val);
+    this->xsi_put_value(this->port_map["reset_fclk"].port_number, &this->zero_val);
 }
 
-void daphne_st_simulator::daphne_st_top_hdl_simulator::set_configuration(const std::string &file){
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_configuration(const std::string &file, const size_t &device_index){
     try{
-        using json = nlohmann::json;
-        std::ifstream config_file(file);
-        if (!config_file.is_open()) {
-            std::cerr << "Error opening configuration file: " << file << std::endl;
-            return;
-        }
-        json config = json::parse(config_file);
-        //std::string json_metadata = config["metadata"];
-
-        //std::cout << json_metadata << std::endl;
-        auto selftrigger_config = config["devices"][0]["self_trigger"];
-        uint64_t enabled_compensator = 0;
-        uint64_t enabled_inverter = 0;
-        uint64_t enabled_channels = 0;
-        this->enabled_channels = {};
-        for(const auto &en_ch : config["devices"][0]["self_trigger"]["enable_compensator"]){
-            enabled_compensator |= (1ULL << en_ch.get<int>());
-            this->enabled_channels.push_back(en_ch.get<int>());
-        }
-        for(auto en_ch : config["devices"][0]["self_trigger"]["enable_inverter"]){
-            enabled_inverter |= (1ULL << en_ch.get<int>());
-        }
-        for(auto en_ch : config["devices"][0]["channels"]["indices"]){
-            enabled_channels |= (1ULL << en_ch.get<int>());
-        }
-        std::cout << "Enabled compensator: " << std::bitset<64>(enabled_compensator) << std::endl;
-        std::cout << "Enabled inverter: " << std::bitset<64>(enabled_inverter) << std::endl;
-        std::cout << "Enabled channels: " << std::bitset<64>(enabled_channels) << std::endl;
-        this->port_values["enable"][0].aVal = (enabled_channels & 0xFFFFFFFF);
-        this->port_values["enable"][1].aVal = ((enabled_channels >> 32) & 0xFFFFFFFF);
-        this->port_values["afe_comp_enable"][0].aVal = (enabled_compensator & 0xFFFFFFFF);
-        this->port_values["afe_comp_enable"][1].aVal = ((enabled_compensator >> 32) & 0xFFFFFFFF);
-        this->port_values["invert_enable"][0].aVal = (enabled_inverter & 0xFFFFFFFF);
-        this->port_values["invert_enable"][1].aVal = ((enabled_inverter >> 32) & 0xFFFFFFFF);
-
-        std::string filter_mode_conf = config["devices"][0]["self_trigger"]["filter_mode"].get<std::string>();
-        std::string slope_mode_conf = config["devices"][0]["self_trigger"]["slope_mode"].get<std::string>();
-        uint32_t slope_threshold = config["devices"][0]["self_trigger"]["slope_threshold"].get<std::uint32_t>();
-        uint32_t pedestal_length = config["devices"][0]["self_trigger"]["pedestal_length"].get<std::uint32_t>();
-        uint32_t spybuffer_channel = config["devices"][0]["self_trigger"]["spybuffer_channel"].get<std::uint32_t>();
-        uint64_t correlation_threshold = config["devices"][0]["self_trigger"]["self_trigger_xcorr"]["correlation_threshold"].get<std::uint64_t>();
-        uint64_t discrimination_threshold = config["devices"][0]["self_trigger"]["self_trigger_xcorr"]["discrimination_threshold"].get<std::uint64_t>();
-
-        uint64_t threshold_xc_val = 0;
-        threshold_xc_val = ((discrimination_threshold  & 0x3FFF) << 28) | (correlation_threshold & 0xFFFFFFF);
-        this->port_values["threshold_xc"][0].aVal = ( threshold_xc_val & 0xFFFFFFFF);
-        this->port_values["threshold_xc"][1].aVal = (( threshold_xc_val >> 32) & 0xFFFFFFFF);
-
-        std::cout << "Filter mode: " << filter_mode_conf << std::endl;
-        std::cout << "Slope mode: " << slope_mode_conf << std::endl;
-        std::cout << "Slope threshold: " << slope_threshold << std::endl;
-        std::cout << "Pedestal length: " << pedestal_length << std::endl;
-        std::cout << "Spybuffer channel: " << spybuffer_channel << std::endl;
-        std::cout << "Correlation threshold: " << correlation_threshold << std::endl;
-        std::cout << "Discrimination threshold: " << discrimination_threshold << std::endl;
-
-        if(filter_mode_conf == "compensated") {
-            this->port_values["filter_output_selector"][0].aVal = (0 & 0x3);
-        } else if(filter_mode_conf == "inverted") {
-            this->port_values["filter_output_selector"][0].aVal = (1 & 0x3);
-        } else if(filter_mode_conf == "xcorr") {
-            this->port_values["filter_output_selector"][0].aVal = (2 & 0x3);
-        } else if(filter_mode_conf == "raw") {
-            this->port_values["filter_output_selector"][0].aVal = (3 & 0x3);
-        } else {
-            throw std::invalid_argument("Invalid filter mode configuration");
-        }
-        
-        if (slope_mode_conf == "20") {
-            this->port_values["st_config"][0].aVal = ((1ULL << 6) & 0xFFFFFFFF);
-        }
-
-        this->port_values["st_config"][0].aVal |= ((slope_threshold << 7) & 0xFFFFFFFF);
-        this->port_values["signal_delay"][0].aVal = (uint16_t(pedestal_length/8) & 0xFFFFFFFF);
-        this->port_values["st_40_signals_enable_reg"][0].aVal = (spybuffer_channel);
-
-        this->set_port_initial_values();
+        self_trigger_configuration configuration = self_trigger_configuration::from_file(file, device_index);
+        configuration.print(std::cout);
+        this->set_configuration(configuration);
     }
     catch (const std::exception& e) {
         std::cerr << "Error setting configuration file in " 
@@ -550,97 +636,900 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::set_configuration(const s
     }
 }
 
-void daphne_st_simulator::daphne_st_top_hdl_simulator::set_input_signal_ports(std::vector<uint16_t> &input_data){
-    // this function is used to set the input values
-    int number_of_enabled_channels = this->enabled_channels.size();
-    int length_of_input_data = input_data.size();
-    if(number_of_enabled_channels != length_of_input_data){
-        std::cerr << "ERROR: Number of enabled channels and length of input data do not match" << std::endl;
-        exit(1);
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_configuration(const self_trigger_configuration &configuration){
+    // writes every configuration port, so it can be applied again on the same open design
+    this->fill_configuration_port_values(configuration);
+    this->configuration = configuration;
+    this->enabled_channels = configuration.input_channels;
+    this->update_enabled_input_ports();
+    this->set_port_initial_values();
+    this->event_log.log(event_type::config, event_level::info, this->output_cycle, configuration.enabled_channels);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::fill_configuration_port_values(const self_trigger_configuration &configuration){
+    uint32_t filter_output_selector = configuration.filter_output_selector();
+    this->port_values["slot_id"][0].aVal = (configuration.slot_id & 0xF);
+    this->port_values["crate_id"][0].aVal = (configuration.crate_id & 0x3FF);
+    this->port_values["detector_id"][0].aVal = (configuration.detector_id & 0x3F);
+    this->port_values["enable"][0].aVal = (configuration.enabled_channels & 0xFFFFFFFF);
+    this->port_values["enable"][1].aVal = ((configuration.enabled_channels >> 32) & 0xFFFFFFFF);
+    this->port_values["afe_comp_enable"][0].aVal = (configuration.enabled_compensator & 0xFFFFFFFF);
+    this->port_values["afe_comp_enable"][1].aVal = ((configuration.enabled_compensator >> 32) & 0xFFFFFFFF);
+    this->port_values["invert_enable"][0].aVal = (configuration.enabled_inverter & 0xFFFFFFFF);
+    this->port_values["invert_enable"][1].aVal = ((configuration.enabled_inverter >> 32) & 0xFFFFFFFF);
+
+    uint64_t threshold_xc_val = 0;
+    threshold_xc_val = ((configuration.discrimination_threshold  & 0x3FFF) << 28) | (configuration.correlation_threshold & 0xFFFFFFF);
+    this->port_values["threshold_xc"][0].aVal = ( threshold_xc_val & 0xFFFFFFFF);
+    this->port_values["threshold_xc"][1].aVal = (( threshold_xc_val >> 32) & 0xFFFFFFFF);
+
+    this->port_values["filter_output_selector"][0].aVal = (filter_output_selector & 0x3);
+
+    this->port_values["st_config"][0].aVal = 0;
+    if (configuration.slope_mode == "20") {
+        this->port_values["st_config"][0].aVal = ((1ULL << 6) & 0xFFFFFFFF);
     }
-    for(int i = 0; i < number_of_enabled_channels; i++){
-        this->port_values[this->signal_input_map[this->enabled_channels[i]]][0].aVal = input_data[i];
-        this->set_port_value(this->signal_input_map[this->enabled_channels[i]]);
+
+    this->port_values["st_config"][0].aVal |= ((configuration.slope_threshold << 7) & 0xFFFFFFFF);
+    this->port_values["signal_delay"][0].aVal = (uint16_t(configuration.pedestal_length/8) & 0xFFFFFFFF);
+    this->port_values["st_40_signals_enable_reg"][0].aVal = (configuration.spybuffer_channel);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::apply_configuration_change(const self_trigger_configuration &configuration){
+    // mid-run: puts only the configuration ports whose value changed, no reset
+    static const char* const configuration_ports[] = {"slot_id", "crate_id", "detector_id", "enable", "afe_comp_enable", "invert_enable",
+                                                      "threshold_xc", "filter_output_selector", "st_config", "signal_delay", "st_40_signals_enable_reg"};
+    std::vector<s_xsi_vlog_logicval> previous[std::size(configuration_ports)];
+    for(size_t i = 0; i < std::size(configuration_ports); i++){
+        previous[i] = this->port_values[configuration_ports[i]];
     }
+    this->fill_configuration_port_values(configuration);
+    for(size_t i = 0; i < std::size(configuration_ports); i++){
+        const std::vector<s_xsi_vlog_logicval> &value = this->port_values[configuration_ports[i]];
+        bool changed = false;
+        for(size_t w = 0; w < value.size(); w++){
+            changed = changed || value[w].aVal != previous[i][w].aVal || value[w].bVal != previous[i][w].bVal;
+        }
+        if(changed){
+            this->xsi_put_value(this->port_map[configuration_ports[i]].port_number, value.data());
+        }
+    }
+    this->configuration = configuration;
+    this->counted_channels |= configuration.enabled_channels;
+    this->event_log.log(event_type::config, event_level::info, this->captured_words, configuration.enabled_channels);
 }
 
-std::vector<uint16_t> daphne_st_simulator::daphne_st_top_hdl_simulator::get_channels_input_data(const std::vector<uint16_t> &input_data, const int &iteration, const int &length_of_waveforms){
-    
-    std::vector<uint16_t> channels_input_data;
-    for(int i = 0; i < this->enabled_channels.size(); i++){
-        channels_input_data.push_back(input_data[i*length_of_waveforms + iteration]);
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_configuration_timeline(std::vector<configuration_change> timeline){
+    std::stable_sort(timeline.begin(), timeline.end(), [](const configuration_change &a, const configuration_change &b) {
+        return a.sample_index < b.sample_index;
+    });
+    for(const auto &it : timeline){
+        if(it.configuration.input_channels != this->enabled_channels){
+            throw std::invalid_argument("A configuration change cannot change input_channels, the inputs driven by run_simulation()");
+        }
+        it.configuration.filter_output_selector();
     }
-    return channels_input_data;
+    this->configuration_timeline = std::move(timeline);
 }
 
-void daphne_st_simulator::daphne_st_top_hdl_simulator::run_simulation(const std::vector<uint16_t> &input_data){
-    // this function is used to run the simulation
-    int number_of_enabled_channels = this->enabled_channels.size();
-    int length_of_input_data = input_data.size()/number_of_enabled_channels;
-    this->reset_design();
-    for(int i = 0; i < length_of_input_data; i++){
-        std::vector<uint16_t> channels_input_data = this->get_channels_input_data(input_data, i, length_of_input_data);
-        this->set_input_signal_ports(channels_input_data);
-        this->cycle_f_clock();
-        this->get_port_value("dout");
-        this->push_back_port_value(this->simulation_stream, this->port_values["dout"][0].aVal);
-        // Two times 
-        this->cycle_f_clock();
-        this->get_port_value("dout");
-        this->push_back_port_value(this->simulation_stream, this->port_values["dout"][0].aVal);
-    }
-    std::cout << "Finished loading data into the simulator." << std::endl;
-    std::cout << "Waiting for end of stream signal..." << std::endl;
-    this->port_values["enable"][0].aVal = 0;
-    this->port_values["enable"][1].aVal = 0;
-    this->set_port_value("enable");
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_external_triggers(const trigger_scheduler_configuration &configuration){
+    this->trigger_scheduler = std::make_unique<daphne_st_trigger_scheduler>(configuration);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_trigger_strobe(const bool &high){
+    // ti_trigger matches adhoc only while strobed, the rest of the time both ports keep their value
+    this->port_values["ti_trigger"][0].aVal = high ? this->trigger_scheduler->get_command() : 0;
+    this->port_values["ti_trigger_stbr"][0].aVal = high ? 1 : 0;
+    this->set_port_value("ti_trigger");
+    this->set_port_value("ti_trigger_stbr");
+    this->trigger_strobe = high;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_input_signal_ports(const uint16_t* channels_input_data){
+    // this function is used to set the input values, one sample per enabled channel
+    s_xsi_vlog_logicval value = this->zero_val;
+    for(size_t i = 0; i < this->enabled_input_ports.size(); i++){
+        value.aVal = channels_input_data[i];
+        this->xsi_put_value(this->enabled_input_ports[i], &value);
+    }
+}
+
+uint32_t daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_and_capture_output(){
+    // one fclk cycle, then hand dout to the writer stage
+    this->cycle_f_clock();
+    return this->capture_output();
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::cycle_sample_and_capture_output(){
+    // one aclk cycle: two fclk cycles, or with scheduled clocks every fclk rising edge up to the next aclk falling one
+    if(!this->scheduled_clocks){
+        this->cycle_and_capture_output();
+        this->cycle_and_capture_output();
+        return;
+    }
+    bool aclk_rose = false;
+    do{
+        const uint32_t rose = this->step_clock_edges();
+        aclk_rose |= (rose >> this->aclk_clock) & 1;
+        if((rose >> this->fclk_clock) & 1){
+            this->capture_output();
+        }
+    }while(!aclk_rose || this->clock_scheduler.peek().time != this->clock_scheduler.get_next_edge_time(this->aclk_clock));
+}
+
+uint32_t daphne_st_simulator::daphne_st_top_hdl_simulator::capture_output(){
+    this->xsi_get_value(this->dout_port, &this->dout_value);
+    uint32_t value = this->dout_value.aVal;
+    // kout only matters for words that look like a SOF or EOF, so idles and payload never read it
+    this->dout_marker = frame_marker::none;
+    if((value & 0xFF) == 0x3C || (value & 0xFF) == 0xDC){
+        this->xsi_get_value(this->kout_port, &this->kout_value);
+        this->dout_marker = classify_word(value, this->kout_value.aVal);
+        if(this->dout_marker == frame_marker::sof){
+            this->sof_flag = true;
+        }
+    }
+    output_block* slot = this->output_slot;
+    slot->markers[slot->n_words] = this->dout_marker;
+    slot->words[slot->n_words++] = value;
+    this->captured_words++;
+    if(this->counter_readout_index >= 0 && this->rcount_registered()){
+        this->step_counter_readout();
+    }
+    if(!this->traced_ports.empty()){
+        this->trace_signals();
+    }
+    if(this->spybuffer_capture){
+        this->capture_spybuffer_trigger();
+    }
+    if(slot->n_words == slot->words.size()){
+        DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::output_wait);
+        this->output_ring->producer_commit();
+        this->output_slot = this->output_ring->wait_producer_slot();
+        this->output_slot->n_words = 0;
+    }
+    return value;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::load_input_blocks(const daphne_st_input_source &source,
+                                                                         daphne_st_spsc_ring<input_block> &input_ring, const std::atomic<bool> &stop){
+    // loader stage: reads the source channel by channel into sample-major blocks
+    const size_t number_of_enabled_channels = this->enabled_channels.size();
+    const uint64_t length_of_input_data = source.get_length();
+    try{
+        std::vector<uint16_t> column(this->pipeline_block_samples);
+        for(uint64_t first = 0; first < length_of_input_data && !stop.load(std::memory_order_relaxed); first += this->pipeline_block_samples){
+            input_block* block = input_ring.wait_producer_slot();
+            DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::load_input);
+            block->n_samples = std::min<uint64_t>(this->pipeline_block_samples, length_of_input_data - first);
+            uint16_t* samples = block->samples.data();
+            for(size_t ch = 0; ch < number_of_enabled_channels; ch++){
+                source.read(ch, first, block->n_samples, column.data());
+                for(size_t i = 0; i < block->n_samples; i++){
+                    samples[i * number_of_enabled_channels + ch] = column[i];
+                }
+            }
+            input_ring.producer_commit();
+        }
+    }
+    catch (...) {
+        // a user source may throw; closing the ring lets the kernel see the end of input and stop
+        this->loader_error = std::current_exception();
+        this->stage_failed.store(true, std::memory_order_release);
+    }
+    input_ring.close();
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::write_output_blocks(daphne_st_spsc_ring<output_block> &output_ring){
+    // writer stage: stores the captured stream and decodes frames while the kernel keeps stepping
+    output_block* block;
+    while((block = output_ring.wait_consumer_slot()) != nullptr){
+        if(this->writer_error == nullptr){
+            try{
+                DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::write_output);
+                for(size_t i = 0; i < block->n_words; i++){
+                    this->push_back_port_value(this->simulation_stream, block->words[i], block->markers[i]);
+                }
+                this->frame_decoder.push(block->words.data(), block->markers.data(), block->n_words);
+            }
+            catch (...) {
+                this->writer_error = std::current_exception();
+                this->stage_failed.store(true, std::memory_order_release);
+            }
+        }
+        // after a failure blocks are still released, so the kernel never waits on a full ring
+        output_ring.consumer_release();
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::start_counter_readout(const uint64_t &sample_index){
+    this->counter_pass.sample_index = sample_index;
+    this->counter_pass.timestamp = this->timestamp_counter;
+    this->counter_pass.end_of_run = false;
+    this->counter_readout_index = 0;
+    this->put_rcount_addr(counter_readout_address(0));
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::put_rcount_addr(const uint32_t &address){
+    this->rcount_addr_value.aVal = address;
+    this->xsi_put_value(this->rcount_addr_port, &this->rcount_addr_value);
+    this->rcount_addr_edge = this->oeiclk_edges;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::step_counter_readout(){
+    // Rcount now holds the counter addressed before the last oeiclk edge
+    this->xsi_get_value(this->rcount_port, this->rcount_value);
+    uint64_t value = (uint64_t(this->rcount_value[1].aVal) << 32) | this->rcount_value[0].aVal;
+    uint32_t index = this->counter_readout_index;
+    if(index < 40){
+        this->counter_pass.trigger_count[index] = value;
+    }else if(index < 80){
+        this->counter_pass.packet_count[index - 40] = value;
+    }else{
+        this->counter_pass.send_count = value;
+    }
+    if(++index == counter_readout_addresses){
+        this->counter_series.push_back(this->counter_pass);
+        this->counter_readout_index = -1;
+        return;
+    }
+    this->counter_readout_index = index;
+    this->put_rcount_addr(counter_readout_address(index));
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::read_counters(const uint64_t &sample_index){
+    // finishes the pass in progress, if any, then runs a whole one
+    while(this->counter_readout_index >= 0){
+        this->cycle_and_capture_output();
+    }
+    this->start_counter_readout(sample_index);
+    while(this->counter_readout_index >= 0){
+        this->cycle_and_capture_output();
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_counter_readout(const bool &enable, const uint64_t &period){
+    this->counter_readout_enabled = enable;
+    this->counter_readout_period = period;
+}
+
+daphne_st_simulator::counter_metrics daphne_st_simulator::daphne_st_top_hdl_simulator::get_counter_metrics() const{
+    if(this->counter_series.empty()){
+        return counter_metrics();
+    }
+    return counter_metrics::from_snapshot(this->counter_series.back(), this->counter_run_samples, this->configuration.enabled_channels);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::write_counter_series(const std::string &filename) const{
+    std::ofstream file(filename, std::ios::trunc);
+    if(!file.is_open()){
+        throw std::runtime_error("Could not open counter output file: " + filename);
+    }
+    write_counter_series_csv(file, this->counter_series);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_filtered_capture(const std::string &filename, const std::vector<uint16_t> &channels, const uint32_t &block_samples){
+    std::vector<int> ports;
+    for(const auto &ch : channels){
+        if(ch >= 40){
+            throw std::invalid_argument("STC input " + std::to_string(ch) + " does not exist, inputs are 0 to 39");
+        }
+        ports.push_back(this->port_map[this->signal_input_map[ch] + "_filtered"].port_number);
+    }
+    if(!filename.empty() && channels.empty()){
+        throw std::invalid_argument("No channels selected for the filtered capture");
+    }
+    this->filtered_capture_file = filename;
+    this->filtered_capture_channels = channels;
+    this->filtered_capture_block_samples = block_samples;
+    this->filtered_ports = ports;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::capture_filtered_outputs(){
+    for(size_t i = 0; i < this->filtered_ports.size(); i++){
+        this->xsi_get_value(this->filtered_ports[i], &this->filtered_value);
+        this->filtered_store.put(i, this->filtered_value.aVal & 0x3FFF);
+    }
+    this->filtered_store.commit_sample();
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::set_signal_trace(const std::string &filename, const std::vector<std::string> &signals){
+    for(const auto &name : signals){
+        if(this->port_map.find(name) == this->port_map.end()){
+            throw std::invalid_argument("Cannot trace " + name + ": not a port of st40_top");
+        }
+    }
+    this->traced_ports.clear();
+    this->traced_words.clear();
+    this->signal_tracer.open(filename);
+    size_t n_words = 0;
+    for(const auto &name : signals){
+        const port_attribute &port = this->port_map[name];
+        this->signal_tracer.add_signal(name, port.port_size);
+        this->traced_ports.push_back(port.port_number);
+        this->traced_words.push_back((port.port_size + 31) / 32);
+        n_words += this->traced_words.back();
+    }
+    this->traced_values.assign(n_words, {0, 0});
+    this->trace_trigger_port = this->spybuffer_port;
+    this->trace_trigger_previous = false;
+    this->trace_cycle = 0;
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::trace_signals(){
+    s_xsi_vlog_logicval* value = this->traced_values.data();
+    for(size_t i = 0; i < this->traced_ports.size(); i++){
+        this->xsi_get_value(this->traced_ports[i], value);
+        value += this->traced_words[i];
+    }
+    bool trigger = false;
+    if(this->signal_tracer.get_window_mode() == trace_window_mode::around_trigger){
+        this->xsi_get_value(this->trace_trigger_port, &this->trace_trigger_value);
+        bool level = this->trace_trigger_value.aVal & 1;
+        trigger = level && !this->trace_trigger_previous;
+        this->trace_trigger_previous = level;
+    }
+    this->signal_tracer.record(this->trace_cycle++, this->run_sample_index, this->traced_values.data(), trigger);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::capture_spybuffer_trigger(){
+    this->xsi_get_value(this->spybuffer_port, &this->spybuffer_value);
+    bool level = this->spybuffer_value.aVal & 1;
+    if(level && !this->spybuffer_previous){
+        this->spybuffer_edges.push_back(this->run_sample_index);
+    }
+    this->spybuffer_previous = level;
+}
+
+daphne_st_simulator::trigger_timeline daphne_st_simulator::daphne_st_top_hdl_simulator::run_trigger_timeline(const std::vector<uint16_t> &input_data, std::vector<uint16_t> channels){
+    if(channels.empty()){
+        for(uint16_t ch = 0; ch < 40; ch++){
+            if((this->configuration.enabled_channels >> ch) & 1){
+                channels.push_back(ch);
+            }
+        }
+    }
+    for(const auto &ch : channels){
+        if(ch >= 40){
+            throw std::invalid_argument("STC input " + std::to_string(ch) + " does not exist, inputs are 0 to 39");
+        }
+    }
+    // set_configuration() on every pass also restores the enable mask the previous drain cleared
+    const self_trigger_configuration configuration = this->configuration;
+    const bool spybuffer_capture = this->spybuffer_capture;
+    trigger_timeline timeline;
+    timeline.channels = channels;
+    this->spybuffer_capture = true;
+    try{
+        for(const auto &ch : channels){
+            self_trigger_configuration pass = configuration;
+            pass.spybuffer_channel = ch;
+            this->set_configuration(pass);
+            this->run_simulation(input_data);
+            timeline.rising_edges.push_back(this->spybuffer_edges);
+        }
+    }
+    catch (...) {
+        this->spybuffer_capture = spybuffer_capture;
+        this->set_configuration(configuration);
+        throw;
+    }
+    this->spybuffer_capture = spybuffer_capture;
+    this->set_configuration(configuration);
+    return timeline;
+}
+
+void daphne_st_simulator::trigger_timeline::write_csv(std::ostream &os) const{
+    os << "input,ch_id,sample_index\n";
+    for(size_t i = 0; i < this->channels.size(); i++){
+        const uint16_t input = this->channels[i];
+        for(const auto &edge : this->rising_edges[i]){
+            os << input << "," << 10 * (input / 8) + input % 8 << "," << edge << "\n";
+        }
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::read_frame_counters(uint64_t &built, uint64_t &sent){
+    // sum of PCount over the inputs enabled during the run, then sendCount; each read waits for one oeiclk edge
+    built = 0;
+    for(uint32_t input = 0; input <= 40; input++){
+        if(input < 40 && !((this->counted_channels >> input) & 1)){
+            continue;
+        }
+        this->put_rcount_addr(counter_readout_address(input < 40 ? 40 + input : 80));
+        do{
+            this->cycle_and_capture_output();
+        }while(!this->rcount_registered());
+        this->xsi_get_value(this->rcount_port, this->rcount_value);
+        uint64_t value = (uint64_t(this->rcount_value[1].aVal) << 32) | this->rcount_value[0].aVal;
+        if(input < 40){
+            built += value;
+        }else{
+            sent = value;
+        }
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::drain_until_sent(){
+    // PCount counts frames when the builder starts them and only while enabled, sendCount counts
+    // EOFs leaving the output mux, so once enable is low the run is over when the two agree.
+    // The sum has to hold still over two passes so a frame started as enable dropped is not missed.
+    // ncycles_stop_condition cycles without a frame sent is kept as a safety net.
+    uint64_t built = 0, sent = 0;
+    uint64_t previous_built = UINT64_MAX, previous_sent = 0;
+    uint64_t last_progress = this->captured_words;
+    while(true){
+        this->read_frame_counters(built, sent);
+        if(built == sent && built == previous_built){
+            this->eof_flag = built != 0;
+            this->event_log.log(event_type::drained, event_level::info, this->captured_words, sent);
+            break;
+        }
+        if(sent != previous_sent){
+            last_progress = this->captured_words;
+        }else if(this->captured_words - last_progress > this->ncycles_stop_condition){
+            this->event_log.log(event_type::idle_timeout, event_level::warning, this->captured_words, this->ncycles_stop_condition);
+            std::cout << "Frame counters did not settle: Simulation stopped after "
+                      << this->ncycles_stop_condition
+                      << " cycles without a frame sent (" << sent << " of " << built << ")." << std::endl;
+            break;
+        }
+        previous_built = built;
+        previous_sent = sent;
+    }
+    if(built == 0){
+        std::cout << "No packets found: no frames were built during the run." << std::endl;
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::drain_until_idle(){
+    // waits for ncycles_stop_condition idle words after every EOF
+    uint32_t dout = this->dout_value.aVal;
     int bc_counter = 0;
-    while(this->port_values["dout"][0].aVal == 0xbc && bc_counter <= this->ncycles_stop_condition && !this->sof_flag){
-        this->cycle_f_clock();
+    while(dout == 0xbc && bc_counter <= this->ncycles_stop_condition && !this->sof_flag){
+        dout = this->cycle_and_capture_output();
         bc_counter++;
-        this->get_port_value("dout");
-        this->push_back_port_value(this->simulation_stream, this->port_values["dout"][0].aVal);
     }
     if(bc_counter >= this->ncycles_stop_condition){
+        this->event_log.log(event_type::idle_timeout, event_level::warning, this->captured_words, this->ncycles_stop_condition);
         std::cout << "No packets found: Simulation stopped after"
                   << this->ncycles_stop_condition
                   << " cycles without receiving end of stream signal." << std::endl;
     }else{
         while(!this->eof_flag){
-            this->cycle_f_clock();
-            this->get_port_value("dout");
-            this->push_back_port_value(this->simulation_stream, this->port_values["dout"][0].aVal);
+            dout = this->cycle_and_capture_output();
             bc_counter = 0;
-            if((this->port_values["dout"][0].aVal & 0xFF) == 0xDC){
-                std::cout << "0xDC found. Waiting for next packet..." << std::endl;
-                this->cycle_f_clock();
-                this->get_port_value("dout");
-                this->push_back_port_value(this->simulation_stream, this->port_values["dout"][0].aVal);
-                while(this->port_values["dout"][0].aVal == 0xbc && bc_counter <= this->ncycles_stop_condition){
-                    this->cycle_f_clock();
-                    this->get_port_value("dout");
-                    this->push_back_port_value(this->simulation_stream, this->port_values["dout"][0].aVal);
+            if(this->dout_marker == frame_marker::eof){
+                dout = this->cycle_and_capture_output();
+                while(dout == 0xbc && bc_counter <= this->ncycles_stop_condition){
+                    dout = this->cycle_and_capture_output();
                     bc_counter++;
                 }
                 if(bc_counter >= this->ncycles_stop_condition){
                     this->eof_flag = true;
-                    std::cout << "Simulation stopped after "  << this->ncycles_stop_condition 
-                              << " cycles without receiving end of stream signal" << std::endl;
-                    std::cout << "Number of packets received: " << this->packet_counter << std::endl;
-                    this->packet_counter = 0;
+                    this->event_log.log(event_type::idle_timeout, event_level::info, this->captured_words, this->ncycles_stop_condition);
                 }
             }
         }
     }
 }
 
-std::vector<dunedaq::fddetdataformats::DAPHNEFrame> daphne_st_simulator::daphne_st_top_hdl_simulator::decode_simulation_stream(const std::vector<uint32_t> &simulation_stream){
-    std::vector<dunedaq::fddetdataformats::DAPHNEFrame> frame_vector;
-    for(auto& it: simulation_stream){
-        dunedaq::fddetdataformats::DAPHNEFrame frame;
-        frame_vector.push_back(frame);
+void daphne_st_simulator::daphne_st_top_hdl_simulator::drain_output_stream(){
+    // disables the channels and keeps stepping until the builders stop sending frames
+    DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::drain);
+    if(this->counter_readout_enabled){
+        // last chance to read TCount, it clears with enable
+        this->read_counters(this->counter_run_samples);
+    }
+    this->port_values["enable"][0].aVal = 0;
+    this->port_values["enable"][1].aVal = 0;
+    this->set_port_value("enable");
+    if(this->drain_on_counters){
+        this->drain_until_sent();
+    }else{
+        this->drain_until_idle();
+    }
+    if(this->counter_readout_enabled){
+        // PCount and sendCount now include the frames that were still in flight
+        std::array<uint64_t, 40> trigger_count = this->counter_series.back().trigger_count;
+        this->read_counters(this->counter_run_samples);
+        this->counter_series.back().trigger_count = trigger_count;
+        this->counter_series.back().end_of_run = true;
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::begin_run(const uint64_t &length_of_input_data){
+    // bookkeeping shared by run_simulation() and run_simulation_dpi(), up to the first input sample
+    this->sof_flag = false;
+    this->eof_flag = false;
+    this->frame_decoder.reset();
+    this->reset_design();
+    this->restart_timestamp();
+    this->captured_words = this->output_cycle;
+    this->run_first_captured_word = this->captured_words;
+    this->event_log.log(event_type::run_start, event_level::info, this->captured_words, length_of_input_data);
+#ifdef DAPHNE_ST_SIM_PROFILING
+    this->profiler.begin_run();
+#endif
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::end_run(const uint64_t &length_of_input_data){
+    // after the drain: run_end, the profiler report and the summary of both run paths
+    this->event_log.log(event_type::run_end, event_level::info, this->captured_words, this->packet_counter);
+#ifdef DAPHNE_ST_SIM_PROFILING
+    this->profiler.end_run(length_of_input_data, this->captured_words - this->run_first_captured_word);
+    this->profiler.print_summary(std::cout);
+    if(!this->profile_report_file.empty()){
+        this->profiler.write_json(this->profile_report_file);
+    }
+#endif
+
+    if(this->eof_flag){
+        if(this->drain_on_counters){
+            std::cout << "Simulation stopped once every frame built had been sent" << std::endl;
+        }else{
+            std::cout << "Simulation stopped after "  << this->ncycles_stop_condition 
+                      << " cycles without receiving end of stream signal" << std::endl;
+        }
+        std::cout << "Number of packets received: " << this->packet_counter << std::endl;
+        this->packet_counter = 0;
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::run_simulation(const std::vector<uint16_t> &input_data){
+    const size_t number_of_enabled_channels = this->enabled_channels.size();
+    if(number_of_enabled_channels == 0 || input_data.size() % number_of_enabled_channels != 0){
+        throw std::invalid_argument("Input data size does not match the number of enabled channels");
     }
-    return frame_vector;
+    this->run_simulation(daphne_st_buffer_source(input_data.data(), number_of_enabled_channels, input_data.size()/number_of_enabled_channels));
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::run_simulation(const daphne_st_input_source &source){
+    // this function is used to run the simulation
+    const size_t number_of_enabled_channels = this->enabled_channels.size();
+    if(number_of_enabled_channels == 0 || source.get_number_of_channels() != number_of_enabled_channels){
+        throw std::invalid_argument("Input source channels do not match the number of enabled channels");
+    }
+    for(const auto &it : this->configuration_timeline){
+        if(it.configuration.input_channels != this->enabled_channels){
+            throw std::invalid_argument("The configuration timeline was set for other input_channels");
+        }
+    }
+    const self_trigger_configuration base_configuration = this->configuration;
+    this->counted_channels = base_configuration.enabled_channels;
+    this->next_configuration_change = 0;
+    this->external_trigger_samples.clear();
+    this->next_trigger_sample = UINT64_MAX;
+    if(this->trigger_scheduler){
+        this->trigger_scheduler->start(this->timestamp_start, this->timestamp_numerator, this->timestamp_denominator);
+        this->next_trigger_sample = this->trigger_scheduler->next();
+        this->port_values["adhoc"][0].aVal = this->trigger_scheduler->get_command();
+        this->set_port_value("adhoc");
+    }
+    const uint64_t length_of_input_data = source.get_length();
+    this->begin_run(length_of_input_data);
+    this->counter_series.clear();
+    this->counter_readout_index = -1;
+    this->counter_run_samples = length_of_input_data;
+    this->run_sample_index = 0;
+    this->run_input_done = false;
+    this->spybuffer_edges.clear();
+    this->spybuffer_previous = false;
+
+    const bool capture_filtered = !this->filtered_capture_file.empty();
+    if(capture_filtered){
+        this->filtered_store.open(this->filtered_capture_file, this->filtered_capture_channels, this->filtered_capture_block_samples);
+    }
+
+    daphne_st_spsc_ring<input_block> input_ring(this->pipeline_depth);
+    for(auto &it : input_ring.get_slots()){
+        it.samples.resize(this->pipeline_block_samples * number_of_enabled_channels);
+    }
+    daphne_st_spsc_ring<output_block> output_ring(this->pipeline_depth);
+    for(auto &it : output_ring.get_slots()){
+        it.words.resize(2 * this->pipeline_block_samples);
+        it.markers.resize(2 * this->pipeline_block_samples);
+    }
+    this->output_ring = &output_ring;
+    this->output_slot = output_ring.wait_producer_slot();
+    this->output_slot->n_words = 0;
+
+    std::atomic<bool> stop{false};
+    this->loader_error = nullptr;
+    this->writer_error = nullptr;
+    this->stage_failed = false;
+    std::thread loader_thread(&daphne_st_top_hdl_simulator::load_input_blocks, this, std::cref(source), std::ref(input_ring), std::cref(stop));
+    std::thread writer_thread(&daphne_st_top_hdl_simulator::write_output_blocks, this, std::ref(output_ring));
+
+    // kernel stage: only put_value / run / get_value from here on
+    try{
+        input_block* block;
+        const uint64_t counter_period = this->counter_readout_enabled ? this->counter_readout_period : 0;
+        uint64_t sample_index = 0;
+        uint64_t next_change_sample = this->configuration_timeline.empty() ? UINT64_MAX : this->configuration_timeline[0].sample_index;
+        while((block = this->next_input_block(input_ring)) != nullptr){
+            if(this->stage_failed.load(std::memory_order_relaxed)){
+                // replaced by the stage's own exception once the threads are joined
+                throw std::runtime_error("A pipeline stage of run_simulation() failed");
+            }
+            const uint16_t* samples = block->samples.data();
+            for(size_t i = 0; i < block->n_samples; i++, sample_index++){
+                this->run_sample_index = sample_index;
+                while(sample_index >= next_change_sample){
+                    this->apply_configuration_change(this->configuration_timeline[this->next_configuration_change++].configuration);
+                    next_change_sample = this->next_configuration_change < this->configuration_timeline.size()
+                                       ? this->configuration_timeline[this->next_configuration_change].sample_index : UINT64_MAX;
+                }
+                if(sample_index == this->next_trigger_sample){
+                    if(!this->trigger_strobe){
+                        this->set_trigger_strobe(true);
+                    }
+                    this->external_trigger_samples.push_back(sample_index);
+                    this->event_log.log(event_type::external_trigger, event_level::debug, this->captured_words, sample_index);
+                    this->next_trigger_sample = this->trigger_scheduler->next();
+                }else if(this->trigger_strobe){
+                    this->set_trigger_strobe(false);
+                }
+                if(counter_period != 0 && sample_index % counter_period == 0 && this->counter_readout_index < 0){
+                    this->start_counter_readout(sample_index);
+                }
+                this->set_input_signal_ports(samples + i * number_of_enabled_channels);
+                this->cycle_sample_and_capture_output();
+                if(capture_filtered){
+                    this->capture_filtered_outputs();
+                }
+            }
+            input_ring.consumer_release();
+        }
+        if(this->stage_failed.load(std::memory_order_acquire)){
+            throw std::runtime_error("A pipeline stage of run_simulation() failed");
+        }
+        this->run_input_done = true;
+        if(this->trigger_strobe){
+            this->set_trigger_strobe(false);
+        }
+        std::cout << "Finished loading data into the simulator." << std::endl;
+        std::cout << "Waiting for end of stream signal..." << std::endl;
+        this->drain_output_stream();
+        if(this->next_configuration_change > 0){
+            // back to the configuration the run started with, enable stays low as the drain left it
+            self_trigger_configuration restored = base_configuration;
+            restored.enabled_channels = 0;
+            this->apply_configuration_change(restored);
+            this->configuration = base_configuration;
+        }
+    }
+    catch (...) {
+        this->configuration = base_configuration;
+        this->run_input_done = true;
+        stop = true;
+        while(input_ring.wait_consumer_slot() != nullptr){
+            input_ring.consumer_release();
+        }
+        this->output_ring->producer_commit();
+        output_ring.close();
+        loader_thread.join();
+        writer_thread.join();
+        this->output_ring = nullptr;
+        this->output_slot = nullptr;
+        try{
+            this->filtered_store.close();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+        }
+        if(this->loader_error != nullptr){
+            std::rethrow_exception(this->loader_error);
+        }
+        if(this->writer_error != nullptr){
+            std::rethrow_exception(this->writer_error);
+        }
+        throw;
+    }
+    this->output_ring->producer_commit();
+    output_ring.close();
+    loader_thread.join();
+    writer_thread.join();
+    this->output_ring = nullptr;
+    this->output_slot = nullptr;
+    this->filtered_store.close();
+    if(this->writer_error != nullptr){
+        // the writer failed during the drain, the stream and decoded frames are incomplete
+        std::rethrow_exception(this->writer_error);
+    }
+    this->end_run(length_of_input_data);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::collect_dpi_words(const uint64_t &until_cycle){
+    // rebuilds the full stream, idles included, up to until_cycle or the last word pushed.
+    // In sparse mode the idles would be dropped again, so only output_cycle is advanced over them.
+    std::vector<dpi_output_word> &words = this->dpi_bridge.get_words();
+    std::vector<uint32_t> &stream = this->dpi_stream;
+    std::vector<frame_marker> &markers = this->dpi_markers;
+    stream.clear();
+    markers.clear();
+    uint64_t n_words = 0;
+    auto skip_idles = [&](const uint64_t &gap){
+        if(this->sparse_capture){
+            this->output_cycle += gap;
+        }else{
+            for(uint64_t i = 0; i < gap; i++){
+                this->push_back_port_value(this->simulation_stream, 0xBC, frame_marker::none);
+            }
+            stream.insert(stream.end(), gap, 0xBC);
+            markers.insert(markers.end(), gap, frame_marker::none);
+        }
+        n_words += gap;
+    };
+    for(const auto &it : words){
+        skip_idles(it.cycle - this->dpi_next_cycle);
+        const frame_marker marker = classify_word(it.word, it.k);
+        this->push_back_port_value(this->simulation_stream, it.word, marker);
+        stream.push_back(it.word);
+        markers.push_back(marker);
+        n_words++;
+        this->dpi_next_cycle = it.cycle + 1;
+        if(marker == frame_marker::sof){
+            this->sof_flag = true;
+        }
+    }
+    if(until_cycle > this->dpi_next_cycle){
+        skip_idles(until_cycle - this->dpi_next_cycle);
+        this->dpi_next_cycle = until_cycle;
+    }
+    this->frame_decoder.push(stream.data(), markers.data(), stream.size());
+    this->captured_words += n_words;
+    words.clear();
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::read_dpi_frame_counters(uint64_t &built, uint64_t &sent){
+    // as read_frame_counters(), with one run() of an aclk cycle per counter; oeiclk is fclk in dpi mode
+    built = 0;
+    for(uint32_t input = 0; input <= 40; input++){
+        if(input < 40 && !((this->configuration.enabled_channels >> input) & 1)){
+            continue;
+        }
+        this->rcount_addr_value.aVal = counter_readout_address(input < 40 ? 40 + input : 80);
+        this->xsi_put_value(this->rcount_addr_port, &this->rcount_addr_value);
+        this->xsi_run(4 * this->clk_sim_step);
+        this->timestamp_counter++;
+        this->xsi_get_value(this->rcount_port, this->rcount_value);
+        uint64_t value = (uint64_t(this->rcount_value[1].aVal) << 32) | this->rcount_value[0].aVal;
+        if(input < 40){
+            built += value;
+        }else{
+            sent = value;
+        }
+    }
+    this->collect_dpi_words(0);
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::drain_dpi_output_stream(){
+    // disables the channels and runs until the frame counters agree (see drain_until_sent()), or,
+    // without drain_on_counters, ncycles_stop_condition fclk cycles at a time until one of them is all idles
+    DAPHNE_ST_PROFILE_SCOPE(this->profiler, daphne_st_profiler::drain);
+    this->port_values["enable"][0].aVal = 0;
+    this->port_values["enable"][1].aVal = 0;
+    this->set_port_value("enable");
+    bool drained = false;
+    if(this->drain_on_counters){
+        // a frame takes about 470 fclk cycles to leave, so the counters are read once per frame time
+        const uint64_t chunk_cycles = 512;
+        uint64_t built = 0, sent = 0;
+        uint64_t previous_built = UINT64_MAX, previous_sent = 0;
+        uint64_t idle_cycles = 0;
+        while(true){
+            this->read_dpi_frame_counters(built, sent);
+            if(built == sent && built == previous_built){
+                drained = true;
+                this->event_log.log(event_type::drained, event_level::info, this->captured_words, sent);
+                break;
+            }
+            idle_cycles = sent != previous_sent ? 0 : idle_cycles + chunk_cycles;
+            if(idle_cycles > this->ncycles_stop_condition){
+                std::cout << "Frame counters did not settle: Simulation stopped after "
+                          << this->ncycles_stop_condition
+                          << " cycles without a frame sent (" << sent << " of " << built << ")." << std::endl;
+                break;
+            }
+            previous_built = built;
+            previous_sent = sent;
+            this->xsi_run(2 * this->clk_sim_step * chunk_cycles);
+            this->timestamp_counter += chunk_cycles / 2;
+            this->collect_dpi_words(0);
+        }
+    }else{
+        const uint64_t chunk_time = 2 * this->clk_sim_step * this->ncycles_stop_condition;
+        bool idle = false;
+        while(!idle){
+            this->xsi_run(chunk_time);
+            this->timestamp_counter += this->ncycles_stop_condition / 2;
+            idle = this->dpi_bridge.get_words().empty();
+            this->collect_dpi_words(0);
+        }
+    }
+    // trailing idles, one word per fclk cycle run in dpi mode
+    this->collect_dpi_words(2 * (this->timestamp_counter - this->timestamp_start));
+    if(drained){
+        this->eof_flag = this->sof_flag;
+        if(!this->sof_flag){
+            std::cout << "No packets found: no frames were built during the run." << std::endl;
+        }
+    }else if(this->drain_on_counters){
+        this->event_log.log(event_type::idle_timeout, event_level::warning, this->captured_words, this->ncycles_stop_condition);
+    }else if(!this->sof_flag){
+        this->event_log.log(event_type::idle_timeout, event_level::warning, this->captured_words, this->ncycles_stop_condition);
+        std::cout << "No packets found: Simulation stopped after"
+                  << this->ncycles_stop_condition
+                  << " cycles without receiving end of stream signal." << std::endl;
+    }else{
+        this->eof_flag = true;
+        this->event_log.log(event_type::idle_timeout, event_level::info, this->captured_words, this->ncycles_stop_condition);
+    }
+}
+
+void daphne_st_simulator::daphne_st_top_hdl_simulator::run_simulation_dpi(const std::vector<uint16_t> &input_data){
+    if(this->dpi_mode_port < 0){
+        throw std::runtime_error("run_simulation_dpi() needs a design elaborated from st40_top_dpi_wrapper");
+    }
+    if(this->linking == xsi_linking::isolated){
+        throw std::runtime_error("run_simulation_dpi() needs the shared XSI linking, the DPI-C bridge lives in the base namespace");
+    }
+    if(this->scheduled_clocks){
+        throw std::invalid_argument("st40_top_dpi_wrapper generates 62.5 / 125 MHz clocks, set_clock_frequencies() does not apply");
+    }
+    if(this->clk_sim_step != 4000){
+        throw std::invalid_argument("st40_top_dpi_wrapper's #4 delays are 4 ns at 1 ps precision, run_simulation_dpi() needs set_clk_sim_step(4000)");
+    }
+    if(this->timestamp_numerator != this->timestamp_denominator){
+        throw std::invalid_argument("st40_top_dpi_wrapper advances the timestamp by one tick per aclk cycle");
+    }
+    if(!this->configuration_timeline.empty() || this->trigger_scheduler){
+        throw std::invalid_argument("st40_top_dpi_wrapper runs the whole input in one call, configuration timelines and external triggers need run_simulation()");
+    }
+    const size_t number_of_enabled_channels = this->enabled_channels.size();
+    if(number_of_enabled_channels == 0 || input_data.size() % number_of_enabled_channels != 0){
+        throw std::invalid_argument("Input data size does not match the number of enabled channels");
+    }
+    const size_t length_of_input_data = input_data.size()/number_of_enabled_channels;
+    this->begin_run(length_of_input_data);
+    // the wrapper counts on from the value on the port when dpi_mode rises
+    this->timestamp_value[0].aVal = this->timestamp_start & 0xFFFFFFFF;
+    this->timestamp_value[1].aVal = (this->timestamp_start >> 32) & 0xFFFFFFFF;
+    this->xsi_put_value(this->timestamp_port, this->timestamp_value);
+    this->timestamp_written = this->timestamp_start;
+
+    this->dpi_bridge.set_input(input_data.data(), length_of_input_data, this->enabled_channels);
+    this->dpi_next_cycle = 0;
+    this->dpi_bridge.install();
+    this->xsi_put_value(this->dpi_mode_port, &this->one_val);
+    try{
+        // sample i is taken by the aclk edge 8 ns + 16 ns * i after dpi_mode rises
+        const uint64_t sample_time = 4 * this->clk_sim_step;
+        uint64_t remaining = length_of_input_data;
+        while(remaining != 0){
+            const uint64_t n_samples = std::min<uint64_t>(remaining, this->dpi_run_samples);
+            this->xsi_run(n_samples * sample_time);
+            this->timestamp_counter += n_samples;
+            remaining -= n_samples;
+            this->collect_dpi_words(0);
+        }
+        std::cout << "Finished loading data into the simulator." << std::endl;
+        std::cout << "Waiting for end of stream signal..." << std::endl;
+        this->drain_dpi_output_stream();
+    }
+    catch (...) {
+        this->xsi_put_value(this->dpi_mode_port, &this->zero_val);
+        daphne_st_dpi_bridge::uninstall();
+        throw;
+    }
+    this->xsi_put_value(this->dpi_mode_port, &this->zero_val);
+    daphne_st_dpi_bridge::uninstall();
+    this->end_run(length_of_input_data);
+}
+
+std::vector<dunedaq::fddetdataformats::DAPHNEFrame> daphne_st_simulator::daphne_st_top_hdl_simulator::decode_simulation_stream(const std::vector<uint32_t> &simulation_stream){
+    return daphne_st_frame_decoder::decode(simulation_stream);
 }
 
 void daphne_st_simulator::daphne_st_top_hdl_simulator::append_logic_val_bit_to_string(std::string& retVal, int aVal, int bVal)
@@ -695,6 +1584,8 @@ std::string daphne_st_simulator::daphne_st_top_hdl_simulator::logic_val_to_strin
 
 void daphne_st_simulator::daphne_st_top_hdl_simulator::close(){
     try {
+        this->event_log.close();
+        this->signal_tracer.close();
         this->loader->close();
     } catch (const std::exception& e) {
         std::cerr << "Error closing the simulator: " << e.what() << std::endl;
@@ -703,13 +1594,22 @@ void daphne_st_simulator::daphne_st_top_hdl_simulator::close(){
     }
 }
 
-void daphne_st_simulator::daphne_st_top_hdl_simulator::push_back_port_value(std::vector<uint32_t> &stream, const uint32_t &value){
+void daphne_st_simulator::daphne_st_top_hdl_simulator::push_back_port_value(std::vector<uint32_t> &stream, const uint32_t &value, const frame_marker &marker){
     // this function is used to push back the value to the stream
-    stream.push_back(value);
-    if((value & 0xFF) == 0x3C){
+    const uint64_t cycle = this->output_cycle++;
+    if(marker == frame_marker::sof){
         this->packet_counter++;
-        this->sof_flag = true;
-        std::cout << "Packet found. Packet number: " << this->packet_counter << std::endl;
+        this->frame_cycles.push_back(cycle);
+        this->sparse_words_left = daphne_st_frame_decoder::payload_words + 2;
+        this->event_log.log(event_type::sof, event_level::info, cycle, this->packet_counter);
+    }else if(marker == frame_marker::eof){
+        this->event_log.log(event_type::eof, event_level::debug, cycle, this->packet_counter);
+    }
+    if(!this->sparse_capture){
+        stream.push_back(value);
+    }else if(this->sparse_words_left != 0){
+        stream.push_back(value);
+        this->sparse_words_left = marker == frame_marker::eof ? 0 : this->sparse_words_left - 1;
     }
 
 }
@@ -0,0 +1,57 @@
+#include "daphne_st_trigger_scheduler.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+daphne_st_simulator::daphne_st_trigger_scheduler::daphne_st_trigger_scheduler(const trigger_scheduler_configuration &configuration)
+    : configuration(configuration){
+    if(this->configuration.pattern != trigger_pattern::list && !(this->configuration.rate > 0.0)){
+        throw std::invalid_argument("The external trigger rate must be positive");
+    }
+    if(!(this->configuration.sample_rate > 0.0)){
+        throw std::invalid_argument("The sample rate must be positive");
+    }
+    this->start(0);
+}
+
+void daphne_st_simulator::daphne_st_trigger_scheduler::start(const uint64_t &timestamp_start, const uint64_t &numerator, const uint64_t &denominator){
+    this->random_engine.seed(this->configuration.seed);
+    this->fired = 0;
+    this->last_sample = 0;
+    this->poisson_time = double(this->configuration.first_sample);
+    this->list_samples.clear();
+    if(this->configuration.pattern == trigger_pattern::list){
+        // first sample whose timestamp reaches the trigger timestamp; earlier ones are dropped
+        for(const auto &it : this->configuration.timestamps){
+            if(it >= timestamp_start){
+                unsigned __int128 ticks = (unsigned __int128)(it - timestamp_start) * denominator;
+                this->list_samples.push_back(uint64_t((ticks + numerator - 1) / numerator));
+            }
+        }
+        std::sort(this->list_samples.begin(), this->list_samples.end());
+    }
+}
+
+uint64_t daphne_st_simulator::daphne_st_trigger_scheduler::next(){
+    uint64_t sample;
+    do{
+        switch(this->configuration.pattern){
+            case trigger_pattern::fixed_rate:
+                sample = this->configuration.first_sample + uint64_t(std::llround(this->fired * this->configuration.sample_rate / this->configuration.rate));
+                break;
+            case trigger_pattern::poisson:{
+                std::exponential_distribution<double> interval(this->configuration.rate / this->configuration.sample_rate);
+                this->poisson_time += interval(this->random_engine);
+                sample = this->poisson_time < 1.8e19 ? uint64_t(this->poisson_time) : UINT64_MAX;
+                break;
+            }
+            default:
+                sample = this->fired < this->list_samples.size() ? this->list_samples[this->fired] : UINT64_MAX;
+                break;
+        }
+        this->fired++;
+    }while(this->fired > 1 && sample == this->last_sample && sample != UINT64_MAX);
+    this->last_sample = sample;
+    return sample;
+}
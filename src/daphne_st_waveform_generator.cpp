@@ -0,0 +1,320 @@
+#include "daphne_st_waveform_generator.h"
+
+#include <cmath>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "nlohmann/json.hpp"
+
+namespace {
+
+inline uint64_t rotl(const uint64_t &x, const int &k){
+    return (x << k) | (x >> (64 - k));
+}
+
+inline uint64_t splitmix64(uint64_t &x){
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Paul Kellet's economy pink noise filter: three leaky integrators plus a direct term.
+constexpr float pink_pole[3] = {0.99765f, 0.96300f, 0.57000f};
+constexpr float pink_gain[3] = {0.0990460f, 0.2965164f, 1.0526913f};
+constexpr float pink_direct = 0.1848f;
+
+}
+
+struct daphne_st_simulator::daphne_st_waveform_generator::channel_state{
+    static constexpr int lanes = 8;
+    uint64_t s0[lanes];
+    uint64_t s1[lanes];
+    uint64_t position = 0;     // absolute index of the next sample
+    double next_arrival = 0.0; // absolute sample time of the next pulse
+    float pink[3] = {0.0f, 0.0f, 0.0f};
+    std::vector<float> work;   // pulses of the current block plus the template length
+    std::vector<float> tail;   // pulse tails spilling into the next block
+    std::vector<float> white;
+    std::vector<float> uniforms;
+    std::vector<generated_pulse> truth;
+
+    void seed(uint64_t seed){
+        for(int l = 0; l < lanes; l++){
+            this->s0[l] = splitmix64(seed);
+            this->s1[l] = splitmix64(seed);
+        }
+    }
+
+    // Uniform floats in (0, 1], lane interleaved so the inner loop vectorizes.
+    void fill_uniform(float* out, const size_t &n){
+        size_t i = 0;
+        for(; i + lanes <= n; i += lanes){
+            for(int l = 0; l < lanes; l++){
+                uint64_t a = this->s0[l];
+                uint64_t b = this->s1[l];
+                uint64_t r = a + b;
+                b ^= a;
+                this->s0[l] = rotl(a, 24) ^ b ^ (b << 16);
+                this->s1[l] = rotl(b, 37);
+                out[i + l] = float((r >> 40) + 1) * 0x1.0p-24f;
+            }
+        }
+        if(i < n){
+            float rest[lanes];
+            this->fill_uniform(rest, lanes);
+            std::copy(rest, rest + (n - i), out + i);
+        }
+    }
+
+    double uniform(){
+        float u;
+        this->fill_uniform(&u, 1);
+        return u;
+    }
+
+    // Standard normal floats, Box-Muller over pairs of uniform arrays.
+    void fill_gaussian(float* out, const size_t &n){
+        size_t pairs = (n + 1) / 2;
+        this->uniforms.resize(2 * pairs);
+        float* u = this->uniforms.data();
+        this->fill_uniform(u, 2 * pairs);
+        for(size_t i = 0; i < pairs; i++){
+            float radius = std::sqrt(-2.0f * std::log(u[i]));
+            float angle = 6.28318530718f * u[pairs + i];
+            out[2 * i] = radius * std::cos(angle);
+            if(2 * i + 1 < n){
+                out[2 * i + 1] = radius * std::sin(angle);
+            }
+        }
+    }
+
+    double gaussian(){
+        double u1 = this->uniform();
+        double u2 = this->uniform();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+};
+
+daphne_st_simulator::daphne_st_waveform_generator::daphne_st_waveform_generator(const waveform_generator_configuration &configuration, const size_t &n_channels){
+    this->configuration = configuration;
+    this->spe_template = default_spe_template(configuration.sensor);
+    this->channels.resize(n_channels);
+    for(size_t ch = 0; ch < n_channels; ch++){
+        this->channels[ch].seed(configuration.seed * 0x100000001B3ULL + ch);
+        this->channels[ch].tail.assign(this->spe_template.size(), 0.0f);
+        if(configuration.photon_rate > 0.0){
+            this->channels[ch].next_arrival = -std::log(this->channels[ch].uniform()) * configuration.sample_rate / configuration.photon_rate;
+        }else{
+            this->channels[ch].next_arrival = INFINITY;
+        }
+    }
+    if(!configuration.amplitude_spectrum.empty()){
+        double total = 0.0;
+        for(const auto &it : configuration.amplitude_spectrum){
+            total += it;
+            this->spectrum_cdf.push_back(total);
+        }
+        for(auto &it : this->spectrum_cdf){
+            it /= total;
+        }
+    }
+    // variance of the pink filter impulse response for unit white input
+    double variance = pink_direct * pink_direct;
+    for(int i = 0; i < 3; i++){
+        variance += 2.0 * pink_direct * pink_gain[i];
+        for(int j = 0; j < 3; j++){
+            variance += pink_gain[i] * pink_gain[j] / (1.0 - pink_pole[i] * pink_pole[j]);
+        }
+    }
+    this->pink_noise_scale = configuration.pink_noise_rms / std::sqrt(variance);
+}
+
+daphne_st_simulator::daphne_st_waveform_generator::~daphne_st_waveform_generator() = default;
+
+daphne_st_simulator::waveform_generator_configuration daphne_st_simulator::daphne_st_waveform_generator::configuration_from_file(const std::string &file, const sipm_type &sensor){
+    using json = nlohmann::json;
+    std::ifstream config_file(file);
+    if(!config_file.is_open()){
+        throw std::runtime_error("Error opening configuration file: " + file);
+    }
+    json config = json::parse(config_file);
+    waveform_generator_configuration configuration;
+    configuration.sensor = sensor;
+    configuration.overvoltage = config["common_conf"]["ov"][sensor == sipm_type::fbk ? "fbk" : "hpk"].get<double>();
+    return configuration;
+}
+
+std::vector<float> daphne_st_simulator::daphne_st_waveform_generator::default_spe_template(const sipm_type &sensor){
+    // AFE shaped SiPM response as a difference of exponentials, time constants in 16 ns samples
+    double rise = (sensor == sipm_type::fbk) ? 2.5 : 2.0;
+    double fall = (sensor == sipm_type::fbk) ? 45.0 : 30.0;
+    size_t length = size_t(std::ceil(10.0 * fall));
+    std::vector<float> shape(length);
+    float peak = 0.0f;
+    for(size_t t = 0; t < length; t++){
+        shape[t] = float(std::exp(-double(t) / fall) - std::exp(-double(t) / rise));
+        peak = std::max(peak, shape[t]);
+    }
+    for(auto &it : shape){
+        it /= peak;
+    }
+    return shape;
+}
+
+void daphne_st_simulator::daphne_st_waveform_generator::set_spe_template(const std::vector<float> &spe_template){
+    if(spe_template.empty()){
+        throw std::invalid_argument("Empty single photoelectron template");
+    }
+    float peak = *std::max_element(spe_template.begin(), spe_template.end(), [](float a, float b){ return std::fabs(a) < std::fabs(b); });
+    if(peak == 0.0f){
+        throw std::invalid_argument("Single photoelectron template has no signal");
+    }
+    this->spe_template = spe_template;
+    for(auto &it : this->spe_template){
+        it /= std::fabs(peak);
+    }
+    for(auto &it : this->channels){
+        it.tail.assign(this->spe_template.size(), 0.0f);
+    }
+}
+
+uint16_t daphne_st_simulator::daphne_st_waveform_generator::draw_photoelectrons(channel_state &state){
+    if(!this->spectrum_cdf.empty()){
+        double u = state.uniform();
+        return uint16_t(std::lower_bound(this->spectrum_cdf.begin(), this->spectrum_cdf.end(), u) - this->spectrum_cdf.begin() + 1);
+    }
+    // zero truncated Poisson, Knuth's method is fine for the small means used here
+    double limit = std::exp(-this->configuration.mean_photoelectrons);
+    for(int attempt = 0; attempt < 16; attempt++){
+        uint16_t k = 0;
+        double p = state.uniform();
+        while(p > limit && k < 1000){
+            k++;
+            p *= state.uniform();
+        }
+        if(k > 0){
+            return k;
+        }
+    }
+    return 1;
+}
+
+void daphne_st_simulator::daphne_st_waveform_generator::generate_channel(channel_state &state, uint16_t* output, const size_t &n_samples){
+    const waveform_generator_configuration &conf = this->configuration;
+    const size_t template_length = this->spe_template.size();
+    const float* shape = this->spe_template.data();
+    const double gain = conf.gain_per_volt * conf.overvoltage;
+    const double mean_interval = (conf.photon_rate > 0.0) ? conf.sample_rate / conf.photon_rate : INFINITY;
+
+    // sparse convolution of the arrivals with the template, tails carried across blocks
+    state.work.assign(n_samples + template_length, 0.0f);
+    float* work = state.work.data();
+    std::copy(state.tail.begin(), state.tail.end(), work);
+    const double block_end = double(state.position + n_samples);
+    while(state.next_arrival < block_end){
+        size_t k = size_t(state.next_arrival - double(state.position));
+        uint16_t photoelectrons = this->draw_photoelectrons(state);
+        float amplitude = float(gain * (photoelectrons + conf.gain_spread * std::sqrt(double(photoelectrons)) * state.gaussian()));
+        float* destination = work + k;
+        for(size_t j = 0; j < template_length; j++){
+            destination[j] += amplitude * shape[j];
+        }
+        if(this->record_truth){
+            state.truth.push_back({state.position + k, photoelectrons});
+        }
+        state.next_arrival += -std::log(state.uniform()) * mean_interval;
+    }
+    std::copy(work + n_samples, work + n_samples + template_length, state.tail.begin());
+
+    // white noise, and a second white sequence shaped into 1/f noise
+    state.white.resize(n_samples);
+    float* white = state.white.data();
+    state.fill_gaussian(white, n_samples);
+    for(size_t i = 0; i < n_samples; i++){
+        work[i] += float(conf.baseline) + float(conf.white_noise_rms) * white[i];
+    }
+    if(conf.pink_noise_rms > 0.0){
+        state.fill_gaussian(white, n_samples);
+        const float scale = float(this->pink_noise_scale);
+        float b0 = state.pink[0], b1 = state.pink[1], b2 = state.pink[2];
+        for(size_t i = 0; i < n_samples; i++){
+            float w = white[i];
+            b0 = pink_pole[0] * b0 + pink_gain[0] * w;
+            b1 = pink_pole[1] * b1 + pink_gain[1] * w;
+            b2 = pink_pole[2] * b2 + pink_gain[2] * w;
+            work[i] += scale * (b0 + b1 + b2 + pink_direct * w);
+        }
+        state.pink[0] = b0;
+        state.pink[1] = b1;
+        state.pink[2] = b2;
+    }
+    if(conf.drift_amplitude != 0.0){
+        // rotate a phasor instead of calling sin() per sample
+        const double step = 6.283185307179586 / conf.drift_period;
+        double phase = std::fmod(double(state.position), conf.drift_period) * step;
+        double c = std::cos(phase), s = std::sin(phase);
+        const double cd = std::cos(step), sd = std::sin(step);
+        for(size_t i = 0; i < n_samples; i++){
+            work[i] += float(conf.drift_amplitude * s);
+            double next_c = c * cd - s * sd;
+            s = s * cd + c * sd;
+            c = next_c;
+        }
+    }
+
+    for(size_t i = 0; i < n_samples; i++){
+        float v = std::nearbyint(work[i]);
+        v = std::min(std::max(v, 0.0f), 16383.0f);
+        output[i] = uint16_t(v);
+    }
+    state.position += n_samples;
+}
+
+void daphne_st_simulator::daphne_st_waveform_generator::generate(uint16_t* buffer, const size_t &n_samples, const size_t &channel_stride){
+    unsigned int n_threads = this->n_threads;
+    if(n_threads == 0){
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    n_threads = std::min<size_t>(n_threads, this->channels.size());
+    auto worker = [&](const unsigned int &t){
+        for(size_t ch = t; ch < this->channels.size(); ch += n_threads){
+            this->generate_channel(this->channels[ch], buffer + ch * channel_stride, n_samples);
+        }
+    };
+    std::vector<std::thread> pool;
+    for(unsigned int t = 1; t < n_threads; t++){
+        pool.emplace_back(worker, t);
+    }
+    if(n_threads > 0){
+        worker(0);
+    }
+    for(auto &it : pool){
+        it.join();
+    }
+}
+
+void daphne_st_simulator::daphne_st_waveform_generator::generate(std::vector<uint16_t> &channel_major, const size_t &n_samples){
+    channel_major.resize(this->channels.size() * n_samples);
+    this->generate(channel_major.data(), n_samples, n_samples);
+}
+
+size_t daphne_st_simulator::daphne_st_waveform_generator::get_number_of_channels() const{
+    return this->channels.size();
+}
+
+uint64_t daphne_st_simulator::daphne_st_waveform_generator::get_generated_samples() const{
+    return this->channels.empty() ? 0 : this->channels[0].position;
+}
+
+const std::vector<daphne_st_simulator::generated_pulse>& daphne_st_simulator::daphne_st_waveform_generator::get_truth(const size_t &channel) const{
+    return this->channels.at(channel).truth;
+}
+
+void daphne_st_simulator::daphne_st_waveform_generator::clear_truth(){
+    for(auto &it : this->channels){
+        it.truth.clear();
+    }
+}
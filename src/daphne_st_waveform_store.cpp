@@ -0,0 +1,165 @@
+#include "daphne_st_waveform_store.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+void write_header(std::ofstream &output, const daphne_st_simulator::waveform_store_header &header){
+    std::vector<char> buffer(header.size(), 0);
+    uint32_t words[4] = {header.magic, header.version, header.block_samples, header.n_channels};
+    memcpy(buffer.data(), words, sizeof(words));
+    memcpy(buffer.data() + 16, &header.total_samples, sizeof(header.total_samples));
+    memcpy(buffer.data() + 24, header.channels.data(), 2 * header.channels.size());
+    output.write(buffer.data(), buffer.size());
+}
+
+}
+
+daphne_st_simulator::daphne_st_waveform_store_writer::~daphne_st_waveform_store_writer(){
+    try{
+        this->close();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+    }
+}
+
+void daphne_st_simulator::daphne_st_waveform_store_writer::open(const std::string &filename, const std::vector<uint16_t> &channels,
+                                                                 const uint32_t &block_samples, const size_t &depth){
+    this->close();
+    if(channels.empty() || block_samples == 0){
+        throw std::invalid_argument("A waveform store needs at least one channel and a non-zero block size");
+    }
+    this->output.open(filename, std::ios::binary | std::ios::trunc);
+    if(!this->output.is_open()){
+        throw std::runtime_error("Could not open waveform store: " + filename);
+    }
+    this->header.block_samples = block_samples;
+    this->header.n_channels = channels.size();
+    this->header.total_samples = 0;
+    this->header.channels = channels;
+    write_header(this->output, this->header);
+
+    this->ring.reset(new daphne_st_spsc_ring<block>(depth));
+    for(auto &it : this->ring->get_slots()){
+        it.columns.resize(size_t(block_samples) * channels.size());
+    }
+    this->encoded.resize(block_samples);
+    this->next_sample = 0;
+    this->write_failed = false;
+    this->current = this->ring->wait_producer_slot();
+    this->current->first_sample = 0;
+    this->current->n_samples = 0;
+    this->writer_thread = std::thread(&daphne_st_waveform_store_writer::write_blocks, this);
+}
+
+void daphne_st_simulator::daphne_st_waveform_store_writer::write_blocks(){
+    block* b;
+    const uint32_t block_samples = this->header.block_samples;
+    while((b = this->ring->wait_consumer_slot()) != nullptr){
+        uint32_t chunk_header[4] = {uint32_t(b->first_sample), uint32_t(b->first_sample >> 32), b->n_samples, 0};
+        this->output.write(reinterpret_cast<const char*>(chunk_header), sizeof(chunk_header));
+        for(uint32_t ch = 0; ch < this->header.n_channels; ch++){
+            const uint16_t* column = b->columns.data() + size_t(ch) * block_samples;
+            int16_t* delta = this->encoded.data();
+            uint16_t previous = 0;
+            for(uint32_t i = 0; i < b->n_samples; i++){
+                delta[i] = int16_t(column[i] - previous);
+                previous = column[i];
+            }
+            std::fill(delta + b->n_samples, delta + block_samples, 0);
+            this->output.write(reinterpret_cast<const char*>(delta), 2 * size_t(block_samples));
+        }
+        if(!this->output){
+            this->write_failed = true;
+        }
+        this->ring->consumer_release();
+    }
+}
+
+void daphne_st_simulator::daphne_st_waveform_store_writer::close(){
+    if(this->current == nullptr){
+        return;
+    }
+    if(this->current->n_samples != 0){
+        this->ring->producer_commit();
+    }
+    this->current = nullptr;
+    this->ring->close();
+    this->writer_thread.join();
+    this->header.total_samples = this->next_sample;
+    this->output.seekp(0);
+    write_header(this->output, this->header);
+    this->output.close();
+    if(this->write_failed || this->output.fail()){
+        throw std::runtime_error("Error writing waveform store");
+    }
+}
+
+daphne_st_simulator::daphne_st_waveform_store_reader::daphne_st_waveform_store_reader(const std::string &filename)
+    : file(filename, MADV_RANDOM){
+    const char* data = this->file.data();
+    uint32_t words[4];
+    if(this->file.size() < 24){
+        throw std::runtime_error("Not a waveform store: " + filename);
+    }
+    memcpy(words, data, sizeof(words));
+    if(words[0] != waveform_store_header::magic || words[1] != waveform_store_header::version){
+        throw std::runtime_error("Not a waveform store (or unsupported version): " + filename);
+    }
+    this->header.block_samples = words[2];
+    this->header.n_channels = words[3];
+    memcpy(&this->header.total_samples, data + 16, sizeof(this->header.total_samples));
+    this->header.channels.resize(this->header.n_channels);
+    if(this->file.size() < this->header.size()){
+        throw std::runtime_error("Truncated waveform store: " + filename);
+    }
+    memcpy(this->header.channels.data(), data + 24, 2 * size_t(this->header.n_channels));
+    uint64_t n_chunks = (this->header.total_samples + this->header.block_samples - 1) / this->header.block_samples;
+    if(this->file.size() < this->header.size() + n_chunks * this->header.chunk_size()){
+        throw std::runtime_error("Truncated waveform store: " + filename);
+    }
+}
+
+void daphne_st_simulator::daphne_st_waveform_store_reader::read(const uint16_t &channel, const uint64_t &first, const uint64_t &count, std::vector<uint16_t> &samples) const{
+    auto it = std::find(this->header.channels.begin(), this->header.channels.end(), channel);
+    if(it == this->header.channels.end()){
+        throw std::invalid_argument("Channel " + std::to_string(channel) + " is not in the waveform store");
+    }
+    const size_t column_index = it - this->header.channels.begin();
+    const uint64_t end = std::min(first + count, this->header.total_samples);
+    samples.clear();
+    if(first >= end){
+        return;
+    }
+    samples.reserve(end - first);
+    const uint32_t block_samples = this->header.block_samples;
+    for(uint64_t chunk = first / block_samples; chunk * block_samples < end; chunk++){
+        const char* column = this->file.data() + this->header.size() + chunk * this->header.chunk_size()
+                           + 16 + 2 * column_index * block_samples;
+        const uint64_t chunk_first = chunk * block_samples;
+        const uint32_t stop = std::min<uint64_t>(end - chunk_first, block_samples);
+        const uint32_t start = first > chunk_first ? first - chunk_first : 0;
+        uint16_t value = 0;
+        for(uint32_t i = 0; i < stop; i++){
+            int16_t delta;
+            memcpy(&delta, column + 2 * i, sizeof(delta));
+            value = uint16_t(value + delta);
+            if(i >= start){
+                samples.push_back(value);
+            }
+        }
+    }
+}
+
+void daphne_st_simulator::daphne_st_waveform_store_reader::read(const uint64_t &first, const uint64_t &count, std::vector<uint16_t> &channel_major) const{
+    std::vector<uint16_t> samples;
+    channel_major.clear();
+    for(const auto &ch : this->header.channels){
+        this->read(ch, first, count, samples);
+        channel_major.insert(channel_major.end(), samples.begin(), samples.end());
+    }
+}
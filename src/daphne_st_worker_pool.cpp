@@ -0,0 +1,115 @@
+#include "daphne_st_worker_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+namespace {
+
+bool read_full(const int &fd, void* buffer, const size_t &size){
+    size_t done = 0;
+    while(done < size){
+        ssize_t n = read(fd, static_cast<char*>(buffer) + done, size - done);
+        if(n == 0){
+            return false;
+        }
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+}
+
+void daphne_st_simulator::daphne_st_worker_pool::run(const unsigned int &n_workers, const size_t &n_tasks, const size_t &record_size,
+                                                     const std::function<void(const next_task_function&, const send_function&)> &worker,
+                                                     const std::function<void(const void*)> &on_record){
+    if(record_size == 0 || record_size > PIPE_BUF){
+        throw std::invalid_argument("Worker records must be between 1 and PIPE_BUF bytes");
+    }
+    if(n_tasks == 0){
+        return;
+    }
+    unsigned int workers_to_start = n_workers != 0 ? n_workers : std::max(1u, std::thread::hardware_concurrency());
+    workers_to_start = std::min<size_t>(workers_to_start, n_tasks);
+
+    // task counter shared by the workers, every process pulls the next task index from it
+    void* shared = mmap(nullptr, sizeof(std::atomic<uint64_t>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED){
+        throw std::runtime_error("Could not map the worker task counter: " + std::string(strerror(errno)));
+    }
+    std::atomic<uint64_t>* next = new (shared) std::atomic<uint64_t>(0);
+    int fds[2];
+    if(pipe(fds) != 0){
+        munmap(shared, sizeof(std::atomic<uint64_t>));
+        throw std::runtime_error("Could not create the worker result pipe: " + std::string(strerror(errno)));
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> workers;
+    for(unsigned int w = 0; w < workers_to_start; w++){
+        pid_t pid = fork();
+        if(pid < 0){
+            std::cerr << "ERROR: could not fork worker: " << strerror(errno) << std::endl;
+            break;
+        }
+        if(pid == 0){
+            close(fds[0]);
+            // the simulator is chatty on stdout, keep the parent's console readable
+            int null_fd = open("/dev/null", O_WRONLY);
+            if(null_fd >= 0){
+                dup2(null_fd, STDOUT_FILENO);
+                close(null_fd);
+            }
+            const int result_fd = fds[1];
+            next_task_function next_task = [next, n_tasks](uint64_t &index){
+                index = next->fetch_add(1);
+                return index < n_tasks;
+            };
+            send_function send = [result_fd, record_size](const void* record){
+                if(write(result_fd, record, record_size) != (ssize_t)record_size){
+                    std::cerr << "ERROR: worker could not send a record: " << strerror(errno) << std::endl;
+                }
+            };
+            int status = 0;
+            try{
+                worker(next_task, send);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "ERROR: worker failed: " << e.what() << std::endl;
+                status = 1;
+            }
+            std::cout.flush();
+            std::cerr.flush();
+            _exit(status);
+        }
+        workers.push_back(pid);
+    }
+    close(fds[1]);
+
+    std::vector<char> record(record_size);
+    while(read_full(fds[0], record.data(), record_size)){
+        on_record(record.data());
+    }
+    close(fds[0]);
+    for(const auto &pid : workers){
+        int status;
+        while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    }
+    munmap(shared, sizeof(std::atomic<uint64_t>));
+}
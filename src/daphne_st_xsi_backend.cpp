@@ -0,0 +1,74 @@
+#include "daphne_st_xsi_backend.h"
+
+#include <dlfcn.h>
+#include <stdexcept>
+
+daphne_st_simulator::daphne_st_xsi_isolated_backend::daphne_st_xsi_isolated_backend(const std::string &design_libname, const std::string &simkernel_libname){
+    this->kernel_library = dlmopen(LM_ID_NEWLM, simkernel_libname.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(this->kernel_library == nullptr){
+        const char* error = dlerror();
+        throw std::runtime_error("Could not open " + simkernel_libname + " in a new namespace: " + (error ? error : "unknown error"));
+    }
+    try{
+        Lmid_t namespace_id;
+        if(dlinfo(this->kernel_library, RTLD_DI_LMID, &namespace_id) != 0){
+            throw std::runtime_error("Could not get the namespace of " + simkernel_libname + ": " + dlerror());
+        }
+        this->design_library = dlmopen(namespace_id, design_libname.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if(this->design_library == nullptr){
+            const char* error = dlerror();
+            throw std::runtime_error("Could not open " + design_libname + ": " + (error ? error : "unknown error"));
+        }
+        // same split as Xsi::Loader: xsi_open comes with the design, the rest from the kernel
+        this->xsi_open = reinterpret_cast<open_function>(this->symbol(this->design_library, "xsi_open", design_libname));
+        this->xsi_close = reinterpret_cast<close_function>(this->symbol(this->kernel_library, "xsi_close", simkernel_libname));
+        this->xsi_run = reinterpret_cast<run_function>(this->symbol(this->kernel_library, "xsi_run", simkernel_libname));
+        this->xsi_get_value = reinterpret_cast<value_function>(this->symbol(this->kernel_library, "xsi_get_value", simkernel_libname));
+        this->xsi_put_value = reinterpret_cast<value_function>(this->symbol(this->kernel_library, "xsi_put_value", simkernel_libname));
+        this->xsi_get_port_number = reinterpret_cast<port_number_function>(this->symbol(this->kernel_library, "xsi_get_port_number", simkernel_libname));
+        this->xsi_trace_all = reinterpret_cast<trace_all_function>(this->symbol(this->kernel_library, "xsi_trace_all", simkernel_libname));
+        this->xsi_get_error_info = reinterpret_cast<error_info_function>(this->symbol(this->kernel_library, "xsi_get_error_info", simkernel_libname));
+    }
+    catch (...) {
+        this->unload();
+        throw;
+    }
+}
+
+daphne_st_simulator::daphne_st_xsi_isolated_backend::~daphne_st_xsi_isolated_backend(){
+    this->close();
+    this->unload();
+}
+
+void* daphne_st_simulator::daphne_st_xsi_isolated_backend::symbol(void* library, const char* name, const std::string &libname){
+    void* address = dlsym(library, name);
+    if(address == nullptr){
+        throw std::runtime_error(std::string(name) + " not found in " + libname);
+    }
+    return address;
+}
+
+void daphne_st_simulator::daphne_st_xsi_isolated_backend::unload(){
+    if(this->design_library != nullptr){
+        dlclose(this->design_library);
+        this->design_library = nullptr;
+    }
+    if(this->kernel_library != nullptr){
+        dlclose(this->kernel_library);
+        this->kernel_library = nullptr;
+    }
+}
+
+void daphne_st_simulator::daphne_st_xsi_isolated_backend::open(p_xsi_setup_info setup_info){
+    this->design_handle = this->xsi_open(setup_info);
+    if(this->design_handle == nullptr){
+        throw std::runtime_error("xsi_open failed");
+    }
+}
+
+void daphne_st_simulator::daphne_st_xsi_isolated_backend::close(){
+    if(this->design_handle != nullptr){
+        this->xsi_close(this->design_handle);
+        this->design_handle = nullptr;
+    }
+}
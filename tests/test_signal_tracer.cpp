@@ -0,0 +1,88 @@
+#include "daphne_st_signal_tracer.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// around_trigger windows: the pre-trigger dump is exactly the pre run cycles ahead of the trigger,
+// then the trigger cycle and post run cycles, whether the trigger comes before or after the
+// history has filled up.
+
+using namespace daphne_st_simulator;
+
+static int failures = 0;
+
+static void check(const bool &condition, const std::string &what){
+    if(!condition){
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// VCD times (#t) of a trace, in fclk cycles
+static std::vector<uint64_t> traced_cycles(const std::string &filename){
+    std::vector<uint64_t> cycles;
+    std::ifstream input(filename);
+    std::string line;
+    while(std::getline(input, line)){
+        if(!line.empty() && line[0] == '#'){
+            cycles.push_back(std::stoull(line.substr(1)) / 8);
+        }
+    }
+    return cycles;
+}
+
+static std::string to_string(const std::vector<uint64_t> &cycles){
+    std::ostringstream text;
+    for(const auto &it : cycles){
+        text << it << " ";
+    }
+    return text.str();
+}
+
+// one record per run cycle with a value that changes every cycle, so every written cycle has a time
+static std::vector<uint64_t> trace_around(const uint64_t &pre, const uint64_t &post, const std::vector<uint64_t> &triggers, const uint64_t &n_cycles){
+    const std::string filename = "test_signal_tracer.vcd";
+    {
+        daphne_st_signal_tracer tracer;
+        tracer.open(filename);
+        tracer.add_signal("counter", 16);
+        tracer.set_trigger_window(pre, post);
+        s_xsi_vlog_logicval value = {0, 0};
+        for(uint64_t cycle = 0; cycle < n_cycles; cycle++){
+            value.aVal = uint32_t(cycle);
+            bool trigger = false;
+            for(const auto &it : triggers){
+                trigger = trigger || it == cycle;
+            }
+            tracer.record(cycle, cycle, &value, trigger);
+        }
+    }
+    std::vector<uint64_t> cycles = traced_cycles(filename);
+    std::remove(filename.c_str());
+    return cycles;
+}
+
+int main(){
+    // trigger after the history has filled: cycles 6-9, the trigger 10, post 11-12, then the gap at 13
+    std::vector<uint64_t> cycles = trace_around(4, 2, {10}, 30);
+    check(cycles == std::vector<uint64_t>({6, 7, 8, 9, 10, 11, 12, 13}), "pre 4 post 2 trigger 10: " + to_string(cycles));
+
+    // trigger before pre cycles have been recorded: only the cycles that exist
+    cycles = trace_around(4, 0, {2}, 10);
+    check(cycles == std::vector<uint64_t>({0, 1, 2, 3}), "pre 4 post 0 trigger 2: " + to_string(cycles));
+
+    // two triggers: the history restarts after the first window
+    cycles = trace_around(3, 1, {5, 20}, 30);
+    check(cycles == std::vector<uint64_t>({2, 3, 4, 5, 6, 7, 17, 18, 19, 20, 21, 22}), "pre 3 post 1 triggers 5, 20: " + to_string(cycles));
+
+    if(failures != 0){
+        std::cerr << failures << " signal tracer checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "signal tracer: all checks passed" << std::endl;
+    return 0;
+}
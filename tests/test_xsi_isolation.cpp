@@ -0,0 +1,121 @@
+#include "daphne_st_sim.h"
+#include "daphne_st_waveform_generator.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+// xsi_linking::isolated: simulators stepping on threads of one process produce the same stream from
+// the same input, and the number of instances stops at the glibc namespace limit with an exception.
+//   test_xsi_isolation [--design xsim.dir/st40_sim/xsimk.so] [--config ./config/conf.json] [--samples N]
+// Skipped (exit 0) when the design library is missing. The measured limit and memory per instance
+// are printed, they are the numbers quoted in daphne_st_xsi_backend.h.
+
+using namespace daphne_st_simulator;
+
+static int failures = 0;
+
+static void check(const bool &condition, const std::string &what){
+    if(!condition){
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+// current resident set, not the high-water mark
+static uint64_t rss_kb(){
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+int main(int argc, char **argv){
+    std::string design = "xsim.dir/st40_sim/xsimk.so";
+    std::string kernel = "librdi_simulator_kernel.so";
+    std::string config = "./config/conf.json";
+    size_t samples = 20000;
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        if(arg == "--design") design = argv[i + 1];
+        else if(arg == "--config") config = argv[i + 1];
+        else if(arg == "--samples") samples = std::stoull(argv[i + 1]);
+    }
+    if(access(design.c_str(), R_OK) != 0){
+        std::cout << "SKIP: xsi isolation, " << design << " not found" << std::endl;
+        return 0;
+    }
+
+    // same stimulus on 4 threads, one isolated simulator each
+    const size_t n_threads = 4;
+    try{
+        std::vector<std::unique_ptr<daphne_st_top_hdl_simulator>> simulators;
+        for(size_t i = 0; i < n_threads; i++){
+            simulators.push_back(std::make_unique<daphne_st_top_hdl_simulator>(design, kernel, xsi_linking::isolated));
+            simulators.back()->set_clk_sim_step(4000);
+            simulators.back()->set_configuration(config);
+        }
+        waveform_generator_configuration stimulus;
+        stimulus.photon_rate = 1.0e3;
+        stimulus.mean_photoelectrons = 3.0;
+        stimulus.seed = 12345;
+        daphne_st_waveform_generator generator(stimulus, simulators[0]->get_enabled_channels().size());
+        std::vector<uint16_t> input_data;
+        generator.generate(input_data, samples);
+        std::vector<std::thread> threads;
+        for(auto &it : simulators){
+            threads.emplace_back([&input_data, &it]() { it->run_simulation(input_data); });
+        }
+        for(auto &it : threads){
+            it.join();
+        }
+        check(!simulators[0]->get_simulation_stream().empty(), "the first instance captured no output");
+        check(!simulators[0]->get_decoded_frames().empty(), "the first instance built no frames");
+        for(size_t i = 1; i < n_threads; i++){
+            check(simulators[i]->get_simulation_stream() == simulators[0]->get_simulation_stream(),
+                  "the stream of instance " + std::to_string(i) + " differs from instance 0");
+        }
+        for(auto &it : simulators){
+            it->close();
+        }
+    }
+    catch (const std::exception& e) {
+        check(false, std::string("threaded isolated run: ") + e.what());
+    }
+
+    // open instances until glibc refuses: at most 15 namespaces next to the base one
+    {
+        std::vector<std::unique_ptr<daphne_st_top_hdl_simulator>> simulators;
+        std::string error;
+        const uint64_t rss_before = rss_kb();
+        while(simulators.size() < 16){
+            try{
+                simulators.push_back(std::make_unique<daphne_st_top_hdl_simulator>(design, kernel, xsi_linking::isolated));
+            }
+            catch (const std::runtime_error& e) {
+                error = e.what();
+                break;
+            }
+        }
+        const uint64_t rss_per_instance = simulators.empty() ? 0 : (rss_kb() - rss_before) / simulators.size();
+        std::cout << "xsi isolation: " << simulators.size() << " instances, " << rss_per_instance
+                  << " kB each, then: " << error << std::endl;
+        check(simulators.size() >= n_threads, "fewer isolated instances than the threaded check used");
+        check(simulators.size() <= 15, "more isolated instances than glibc namespaces");
+        check(!error.empty(), "opening one instance too many did not throw std::runtime_error");
+        for(auto &it : simulators){
+            it->close();
+        }
+    }
+
+    if(failures != 0){
+        std::cerr << failures << " xsi isolation checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "xsi isolation: all checks passed" << std::endl;
+    return 0;
+}